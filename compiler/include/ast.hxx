@@ -2,6 +2,9 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <string>
 #include <vector>
 
 #include "tokenizer.hxx"
@@ -26,42 +29,134 @@ class type {
   // other methods
 };
 
-class ast_base {
- public:
-  virtual ~ast_base() {}
-
-  void set_start(source_pos start);
-  void set_end(source_pos end);
+using ast_index = std::uint32_t;
 
- private:
-  source_range loc_;
-};
+inline constexpr ast_index no_node = ~ast_index{0};
 
-class ast_stmt;
+enum class ast_kind : std::uint8_t { block, decl_stmt };
 
-class ast_block : public ast_base {
- public:
- private:
-  std::vector<std::unique_ptr<ast_stmt>> stmts_;
+// One node of the tree. Tokens are indices into the tokenizer's token_buffer.
+// The meaning of lhs / rhs depends on the kind:
+//  block:     children [lhs, lhs + rhs) in the arena's child list, first / last token are the brackets
+//  decl_stmt: <type> <name> = <value>: first token is the type, lhs the name token, rhs the value token
+struct ast_node {
+  ast_kind kind;
+  std::uint32_t first_token;
+  std::uint32_t last_token;
+  std::uint32_t lhs;
+  std::uint32_t rhs;
 };
 
-class ast_stmt : public ast_base {
+// Owns every node of one compilation unit, in a few contiguous arrays that are freed at once.
+// Children of a node are a contiguous range of indices, not owning pointers.
+class ast_arena {
  public:
-};
+  ast_index add(ast_node node) {
+    nodes_.push_back(node);
+    return static_cast<ast_index>(nodes_.size() - 1);
+  }
+
+  ast_node& operator[](ast_index i) noexcept { return nodes_[i]; }
+  ast_node const& operator[](ast_index i) const noexcept { return nodes_[i]; }
+
+  std::size_t size() const noexcept { return nodes_.size(); }
+
+  struct child_range {
+    ast_index const* b;
+    ast_index const* e;
+    ast_index const* begin() const noexcept { return b; }
+    ast_index const* end() const noexcept { return e; }
+    std::size_t size() const noexcept { return static_cast<std::size_t>(e - b); }
+  };
+
+  child_range children(ast_index parent) const noexcept {
+    auto const& n = nodes_[parent];
+    if (n.kind != ast_kind::block) {
+      return {nullptr, nullptr};
+    }
+    return {children_.data() + n.lhs, children_.data() + n.lhs + n.rhs};
+  }
+
+  // Children are collected on a stack while their parent is parsed, and moved to a contiguous range at the end.
+  // Nested parents open their own range above the enclosing one.
+  std::size_t open_children() const noexcept { return pending_.size(); }
+  void push_child(ast_index child) { pending_.push_back(child); }
+  void close_children(ast_index parent, std::size_t opened) {
+    nodes_[parent].lhs = static_cast<std::uint32_t>(children_.size());
+    nodes_[parent].rhs = static_cast<std::uint32_t>(pending_.size() - opened);
+    children_.insert(children_.end(), pending_.begin() + static_cast<std::ptrdiff_t>(opened), pending_.end());
+    pending_.resize(opened);
+  }
+
+  // puts replacement in the place of child in the parent's child range
+  void replace_child(ast_index parent, ast_index child, ast_index replacement) noexcept {
+    auto const& n = nodes_[parent];
+    std::replace(children_.begin() + n.lhs, children_.begin() + n.lhs + n.rhs, child, replacement);
+  }
+
+  // Preorder walk without recursion, f(index, node) for each node of the subtree.
+  template <typename F>
+  void walk(ast_index root, F&& f) const {
+    std::vector<ast_index> stack{root};
+    while (!stack.empty()) {
+      const auto i = stack.back();
+      stack.pop_back();
+      f(i, nodes_[i]);
+      const auto cs = children(i);
+      for (auto it = cs.e; it != cs.b;) {
+        stack.push_back(*--it);
+      }
+    }
+  }
+
+  // drops every node, the arrays keep their capacity for the next tree
+  void clear() noexcept {
+    nodes_.clear();
+    children_.clear();
+    pending_.clear();
+  }
+
+  // the raw arrays, for serialization
+  std::vector<ast_node> const& node_array() const noexcept { return nodes_; }
+  std::vector<ast_index> const& child_array() const noexcept { return children_; }
+
+  std::size_t memory_usage() const noexcept {
+    return nodes_.capacity() * sizeof(ast_node) + (children_.capacity() + pending_.capacity()) * sizeof(ast_index);
+  }
+
+  // rolls back every node added since its creation, unless committed
+  // with keep_nodes only the pending children are dropped, the nodes stay (unreferenced) for memoized parses
+  class checkpointer {
+   public:
+    checkpointer(ast_arena& a, bool keep_nodes = false) noexcept
+        : a_(a)
+        , nodes_(a.nodes_.size())
+        , children_(a.children_.size())
+        , pending_(a.pending_.size())
+        , keep_nodes_(keep_nodes) {}
+    ~checkpointer() {
+      if (!committed_) {
+        if (!keep_nodes_) {
+          a_.nodes_.resize(nodes_);
+          a_.children_.resize(children_);
+        }
+        a_.pending_.resize(pending_);
+      }
+    }
+
+    void commit() noexcept { committed_ = true; }
+
+   private:
+    ast_arena& a_;
+    std::size_t nodes_;
+    std::size_t children_;
+    std::size_t pending_;
+    bool keep_nodes_;
+    bool committed_ = false;
+  };
 
-class ast_construct_stmt : public ast_stmt {
- public:
- private:
-  // constructor ref
-  // parameter list
-};
-
-class ast_decl_stmt : public ast_stmt {
- public:
  private:
-  type const& t_;
-  std::string_view name_;                            // as in the source
-  std::unique_ptr<ast_construct_stmt> constructor_;  // or null
+  std::vector<ast_node> nodes_;
+  std::vector<ast_index> children_;
+  std::vector<ast_index> pending_;
 };
-
-// ...
@@ -0,0 +1,87 @@
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// character classes used by the tokenizer, one bit per class
+enum char_class : std::uint8_t {
+  cc_whitespace = 1 << 0,
+  cc_digit = 1 << 1,
+  cc_identifier_start = 1 << 2,
+  cc_operator = 1 << 3,
+  cc_bracket = 1 << 4,
+  cc_semicolon = 1 << 5,
+  cc_identifier = cc_digit | cc_identifier_start,
+};
+
+constexpr std::array<std::uint8_t, 256> make_char_class_table() noexcept {
+  std::array<std::uint8_t, 256> table{};
+  for (auto c : {' ', '\t', '\n', '\r'}) {
+    table[static_cast<unsigned char>(c)] |= cc_whitespace;
+  }
+  for (char c = '0'; c <= '9'; ++c) {
+    table[static_cast<unsigned char>(c)] |= cc_digit;
+  }
+  for (char c = 'a'; c <= 'z'; ++c) {
+    table[static_cast<unsigned char>(c)] |= cc_identifier_start;
+    table[static_cast<unsigned char>(c - 'a' + 'A')] |= cc_identifier_start;
+  }
+  table[static_cast<unsigned char>('_')] |= cc_identifier_start;
+  for (auto c : {'-', '+', '?', '!', '*', '/', '\\', '^', '$', '@', '%', '~', '|', '=', '<', '>', ':'}) {
+    table[static_cast<unsigned char>(c)] |= cc_operator;
+  }
+  for (auto c : {'(', ')', '[', ']', '{', '}'}) {
+    table[static_cast<unsigned char>(c)] |= cc_bracket;
+  }
+  table[static_cast<unsigned char>(';')] |= cc_semicolon;
+  return table;
+}
+
+inline constexpr std::array<std::uint8_t, 256> char_class_table = make_char_class_table();
+
+constexpr bool has_class(char c, std::uint8_t classes) noexcept {
+  return (char_class_table[static_cast<unsigned char>(c)] & classes) != 0;
+}
+
+// Run scanners: return the first position in [begin, end) whose character is not in the class.
+// They never read outside [begin, end).
+using scan_fn = const char* (*)(const char* begin, const char* end) noexcept;
+
+// Appends the offset (from begin) of the character following each '\n' in [begin, end).
+using line_starts_fn = void (*)(const char* begin, const char* end, std::vector<std::uint32_t>& starts);
+
+struct scan_kernels {
+  const char* name;
+  scan_fn whitespace;
+  scan_fn identifier;
+  scan_fn digits;
+  line_starts_fn line_starts;
+};
+
+// the kernel set selected for the running cpu
+scan_kernels const& active_scan_kernels() noexcept;
+
+// every kernel set usable on the running cpu, scalar first
+std::vector<scan_kernels const*> available_scan_kernels();
+
+inline const char* scan_whitespace(const char* begin, const char* end) noexcept {
+  return active_scan_kernels().whitespace(begin, end);
+}
+
+inline const char* scan_identifier(const char* begin, const char* end) noexcept {
+  return active_scan_kernels().identifier(begin, end);
+}
+
+inline const char* scan_digits(const char* begin, const char* end) noexcept {
+  return active_scan_kernels().digits(begin, end);
+}
+
+inline void find_line_starts(const char* begin, const char* end, std::vector<std::uint32_t>& starts) {
+  active_scan_kernels().line_starts(begin, end, starts);
+}
+
+// Decodes the decimal digits [begin, end) into value, 8 digits per step on little endian targets. Returns false if the
+// number doesn't fit in 64 bits, value is unchanged then.
+bool decode_digits(const char* begin, const char* end, std::uint64_t& value) noexcept;
@@ -0,0 +1,62 @@
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "instrument.hxx"
+#include "source.hxx"
+
+struct driver_options {
+  std::size_t jobs = 0;  // 0: one per hardware thread
+  std::vector<std::string> files;
+  std::string trace_path;  // Chrome trace output, needs an instrumented build
+  std::string cache_dir;   // lexed and parsed files are reused from here, none if empty
+  bool pipeline = false;   // lex each file on a second thread while it is parsed
+};
+
+// time and volume of one phase, summed over files
+struct phase_stats {
+  double seconds = 0;
+  std::size_t bytes = 0;
+  std::size_t tokens = 0;
+};
+
+struct file_result {
+  std::string path;
+  std::size_t bytes = 0;
+  std::size_t tokens = 0;
+  bool parsed = false;
+  bool cached = false;  // lexing and parsing were skipped, the results came from the cache
+  diagnostic_reporter diagnostics;
+  phase_stats read;
+  phase_stats lex;
+  phase_stats parse;
+};
+
+struct driver_result {
+  std::vector<file_result> files;  // in the order of the command line
+  double wall_seconds = 0;
+  std::size_t jobs = 0;
+  std::unique_ptr<trace_recorder> trace;  // a track per file, only in instrumented builds
+
+  bool has_errors() const noexcept;
+};
+
+// Lexes and parses every file, concurrently on a work stealing pool.
+driver_result run_driver(driver_options const& options);
+
+// Prints the diagnostics of every file in file order, then the per phase summary, to stderr.
+void report_driver_result(driver_result const& result);
+
+// Writes the Chrome trace of an instrumented run, returns false if it can't.
+bool write_driver_trace(driver_result const& result, std::string const& path);
+
+// the largest job count -j accepts: 4 per hardware thread, at least 64
+std::size_t max_driver_jobs() noexcept;
+
+// Parses the command line: [-j N] [--trace file] [--cache dir] [--pipeline] files..., returns false on invalid
+// arguments, and job counts over max_driver_jobs(). The file - is stdin.
+bool parse_driver_options(int argc, char const* const* argv, driver_options& options, std::string& error);
@@ -0,0 +1,35 @@
+
+#pragma once
+
+#include <utility>
+
+template <typename E>
+struct unexpected {
+  E error;
+};
+
+template <typename E>
+unexpected(E) -> unexpected<E>;
+
+// A value, or the error that prevented it: failures are plain returns, no unwinding.
+// T and E have to be default constructible and cheap to copy.
+template <typename T, typename E>
+class expected {
+ public:
+  expected(T value) noexcept : value_(std::move(value)), has_value_(true) {}  // NOLINT: implicit on purpose
+  expected(unexpected<E> u) noexcept : error_(std::move(u.error)), has_value_(false) {}  // NOLINT
+
+  bool has_value() const noexcept { return has_value_; }
+  explicit operator bool() const noexcept { return has_value_; }
+
+  T const& value() const noexcept { return value_; }
+  T const& operator*() const noexcept { return value_; }
+  T const* operator->() const noexcept { return &value_; }
+
+  E const& error() const noexcept { return error_; }
+
+ private:
+  T value_{};
+  E error_{};
+  bool has_value_;
+};
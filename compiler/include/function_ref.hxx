@@ -0,0 +1,41 @@
+
+#pragma once
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+template <typename Signature>
+class function_ref;
+
+// Non-owning reference to a callable: two pointers, no allocation, one indirect call.
+// The referenced callable has to outlive the function_ref.
+template <typename R, typename... Args>
+class function_ref<R(Args...)> {
+ public:
+  template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, function_ref> &&
+                                                    std::is_invocable_r_v<R, F&, Args...>>>
+  function_ref(F&& f) noexcept  // NOLINT: implicit on purpose, like std::function
+      : obj_(const_cast<void*>(static_cast<const void*>(std::addressof(f)))), call_(&invoke<std::remove_reference_t<F>>) {}
+
+  // binds a member function to an object, e.g. function_ref<bool(int)>::bind<&foo::check>(f)
+  template <auto Method, typename C>
+  static function_ref bind(C& obj) noexcept {
+    return function_ref{const_cast<void*>(static_cast<const void*>(&obj)), [](void* o, Args... args) -> R {
+                          return (static_cast<C*>(o)->*Method)(std::forward<Args>(args)...);
+                        }};
+  }
+
+  R operator()(Args... args) const { return call_(obj_, std::forward<Args>(args)...); }
+
+ private:
+  void* obj_;
+  R (*call_)(void*, Args...);
+
+  function_ref(void* obj, R (*call)(void*, Args...)) noexcept : obj_(obj), call_(call) {}
+
+  template <typename F>
+  static R invoke(void* obj, Args... args) {
+    return (*static_cast<F*>(obj))(std::forward<Args>(args)...);
+  }
+};
@@ -0,0 +1,13 @@
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// XXH64: fast, not cryptographic. The values are stable across runs and platforms, content addressing depends on it.
+std::uint64_t hash_bytes(std::string_view data, std::uint64_t seed = 0) noexcept;
+
+// order dependent
+inline std::uint64_t hash_combine(std::uint64_t h, std::uint64_t value) noexcept {
+  return h ^ (value + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2));
+}
@@ -0,0 +1,13 @@
+
+#pragma once
+
+#include "ast.hxx"
+#include "tokenizer.hxx"
+
+// Updates the tree of one top level block after tokenizer::apply_edit. Token indices of the untouched nodes are
+// shifted, and only the innermost block whose brackets enclose the changed tokens is parsed again, in a scope chain
+// rebuilt from its ancestors. If that block ends somewhere else now, the enclosing one is tried.
+// Returns the root, which is a new node if the root block itself was parsed again, or no_node if the edit is outside
+// of the root or the root doesn't parse the same span anymore: a full parse is needed then, for the diagnostics too.
+// Replaced nodes, and those of failed attempts, stay in the arena unreferenced until it is freed.
+ast_index reparse_after_edit(tokenizer& t, ast_arena& arena, ast_index root, token_edit const& edit);
@@ -0,0 +1,149 @@
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "token_buffer.hxx"
+
+// Built with METAMORF_INSTRUMENT=1 the front end records phase timers and counters, otherwise every hook below
+// compiles to nothing.
+#ifndef METAMORF_INSTRUMENT
+#define METAMORF_INSTRUMENT 0
+#endif
+
+namespace spdlog {
+class logger;
+}
+
+enum class counter : std::uint8_t { rollbacks, discarded_tokens, operator_lookups, diagnostics, count };
+
+struct counter_set {
+  std::array<std::uint64_t, static_cast<std::size_t>(counter::count)> counters{};
+  std::array<std::uint64_t, static_cast<std::size_t>(token_type::eof) + 1> tokens{};  // lexed, by token_type
+
+  std::uint64_t operator[](counter c) const noexcept { return counters[static_cast<std::size_t>(c)]; }
+  std::uint64_t operator[](token_type t) const noexcept { return tokens[static_cast<std::size_t>(t)]; }
+
+  counter_set& operator+=(counter_set const& other) noexcept;
+};
+
+struct trace_event {
+  char const* name;  // a literal
+  std::uint64_t start_ns;  // since the creation of the recorder
+  std::uint64_t duration_ns;
+};
+
+// the work recorded under one binding, e.g. a file: its counters and phases, all on one thread
+struct trace_track {
+  std::string name;
+  std::uint32_t thread = 0;
+  std::chrono::steady_clock::time_point origin;  // of the recorder
+  std::uint64_t start_ns = 0;
+  std::uint64_t duration_ns = 0;
+  counter_set counts;
+  std::vector<trace_event> events;
+};
+
+// Collects the tracks of every thread. Threads only write their own track, without locking; the results can be read
+// once the bindings ended.
+class trace_recorder {
+ public:
+  static constexpr bool enabled = METAMORF_INSTRUMENT != 0;
+
+  trace_recorder() noexcept;
+  trace_recorder(trace_recorder const&) = delete;
+  trace_recorder& operator=(trace_recorder const&) = delete;
+
+  // ordered by start
+  std::vector<trace_track> tracks() const;
+  counter_set totals() const;
+
+  // Chrome trace_event JSON (chrome://tracing, Perfetto): a complete event for every track and phase, the counters
+  // are the arguments of the tracks
+  void write_chrome_trace(std::ostream& out) const;
+
+  // the totals and the slowest tracks, to the given logger or stderr
+  void log_summary(std::size_t slowest = 5) const;
+  void log_summary(spdlog::logger& log, std::size_t slowest = 5) const;
+
+ private:
+  friend class trace_binding;
+
+  std::chrono::steady_clock::time_point origin_;
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<trace_track>> tracks_;
+
+  trace_track* open_track(std::string name);
+};
+
+// the track the calling thread records into, if any
+inline trace_track*& current_track() noexcept {
+  static thread_local trace_track* track = nullptr;
+  return track;
+}
+
+// Records the work of the calling thread into a new track until destroyed. Bindings nest, a null recorder records
+// nothing.
+class trace_binding {
+ public:
+  trace_binding(trace_recorder* recorder, std::string name);
+  trace_binding(trace_binding const&) = delete;
+  trace_binding& operator=(trace_binding const&) = delete;
+  ~trace_binding();
+
+ private:
+  trace_track* track_ = nullptr;
+  trace_track* previous_ = nullptr;
+};
+
+inline void count_event(counter c, std::uint64_t n = 1) noexcept {
+  if constexpr (trace_recorder::enabled) {
+    if (auto* track = current_track()) {
+      track->counts.counters[static_cast<std::size_t>(c)] += n;
+    }
+  }
+}
+
+inline void count_token(token_type type) noexcept {
+  if constexpr (trace_recorder::enabled) {
+    if (auto* track = current_track()) {
+      ++track->counts.tokens[static_cast<std::size_t>(type)];
+    }
+  }
+}
+
+// times a phase of the current track, name has to be a literal
+class phase_timer {
+ public:
+  explicit phase_timer(char const* name) noexcept {
+    if constexpr (trace_recorder::enabled) {
+      name_ = name;
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  phase_timer(phase_timer const&) = delete;
+  phase_timer& operator=(phase_timer const&) = delete;
+
+  ~phase_timer() {
+    if constexpr (trace_recorder::enabled) {
+      if (auto* track = current_track()) {
+        const auto ns = [](auto d) {
+          return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+        };
+        track->events.push_back(
+            {name_, ns(start_ - track->origin), ns(std::chrono::steady_clock::now() - start_)});
+      }
+    }
+  }
+
+ private:
+  char const* name_ = nullptr;
+  std::chrono::steady_clock::time_point start_;
+};
@@ -0,0 +1,106 @@
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// the transitions of an operator_trie built at compile time, see make_operator_table
+template <std::size_t States, std::size_t Width>
+struct static_operator_table {
+  std::array<std::uint16_t, 256> column{};
+  std::array<std::uint32_t, States * Width> next{};
+  std::size_t count = 0;
+};
+
+// Operator spellings compiled into a DFA: one flat transition table, a row per state and a column per character
+// that occurs in some operator. Walking it costs one load per character, every state is a prefix of an operator.
+class operator_trie {
+ public:
+  using state = std::uint32_t;
+
+  static constexpr state dead = 0;  // row 0 only leads to itself
+  static constexpr state root = 1;
+
+  operator_trie() noexcept = default;  // empty, allocates on the first insert
+
+  template <std::size_t States, std::size_t Width>
+  explicit operator_trie(static_operator_table<States, Width> const& table)
+      : column_(table.column), width_(Width), next_(table.next.begin(), table.next.end()), count_(table.count) {}
+
+  // a new character widens the table, otherwise only the missing states are added
+  void insert(std::string_view op);
+
+  bool empty() const noexcept { return count_ == 0; }
+
+  state step(state s, char c) const noexcept { return next_[s * width_ + column_[static_cast<unsigned char>(c)]]; }
+
+  // text is an operator or the prefix of one
+  bool prefix(std::string_view text) const noexcept {
+    if (empty()) {
+      return false;
+    }
+    state s = root;
+    for (char c : text) {
+      s = step(s, c);
+    }
+    return s != dead;
+  }
+
+ private:
+  std::array<std::uint16_t, 256> column_{};  // column 0: the character is in no operator
+  std::uint32_t width_ = 1;
+  std::vector<state> next_;  // next_[s * width_ + column], the rows of dead and root first
+  std::size_t count_ = 0;
+};
+
+template <std::size_t N>
+constexpr std::size_t operator_table_width(std::array<std::string_view, N> const& ops) {
+  std::array<bool, 256> seen{};
+  std::size_t width = 1;
+  for (auto op : ops) {
+    for (char c : op) {
+      if (!seen[static_cast<unsigned char>(c)]) {
+        seen[static_cast<unsigned char>(c)] = true;
+        ++width;
+      }
+    }
+  }
+  return width;
+}
+
+// an upper bound, rows of shared prefixes stay unused
+template <std::size_t N>
+constexpr std::size_t operator_table_states(std::array<std::string_view, N> const& ops) {
+  std::size_t states = 2;
+  for (auto op : ops) {
+    states += op.size();
+  }
+  return states;
+}
+
+// The same table operator_trie::insert builds, as a constant:
+//   constexpr auto table = make_operator_table<operator_table_states(ops), operator_table_width(ops)>(ops);
+template <std::size_t States, std::size_t Width, std::size_t N>
+constexpr static_operator_table<States, Width> make_operator_table(std::array<std::string_view, N> const& ops) {
+  static_operator_table<States, Width> table{};
+  std::uint16_t width = 1;
+  std::uint32_t states = 2;
+  for (auto op : ops) {
+    std::uint32_t s = operator_trie::root;
+    for (char c : op) {
+      auto& column = table.column[static_cast<unsigned char>(c)];
+      if (column == 0) {
+        column = width++;
+      }
+      auto& next = table.next[s * Width + column];
+      if (next == operator_trie::dead) {
+        next = states++;
+      }
+      s = next;
+    }
+    ++table.count;
+  }
+  return table;
+}
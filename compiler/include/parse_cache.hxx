@@ -0,0 +1,92 @@
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.hxx"
+#include "token_buffer.hxx"
+
+class parser_context;
+
+// A cache entry in its on-disk form, mapped read-only: the arrays are used in place, nothing is decoded.
+// Symbols are not stored (ids are per process), identifiers are interned from the source text when needed. The
+// decoded values of numerics and their signs are stored.
+class cached_unit {
+ public:
+  cached_unit(cached_unit&& other) noexcept;
+  cached_unit& operator=(cached_unit&&) = delete;
+  ~cached_unit();
+
+  std::size_t token_count() const noexcept { return token_count_; }
+  token_type kind(std::size_t i) const noexcept { return kinds_[i]; }
+  std::uint32_t start(std::size_t i) const noexcept { return starts_[i]; }
+  std::uint32_t length(std::size_t i) const noexcept { return lengths_[i]; }
+  bool error(std::size_t i) const noexcept { return (errors_[i / 64] >> (i % 64)) & 1u; }
+  std::uint64_t value(std::size_t i) const noexcept {
+    return kinds_[i] == token_type::numeric ? values_[value_indices_[i]] : 0;
+  }
+  bool negative(std::size_t i) const noexcept { return (negatives_[i / 64] >> (i % 64)) & 1u; }
+
+  std::size_t node_count() const noexcept { return node_count_; }
+  ast_node const& node(ast_index i) const noexcept { return nodes_[i]; }
+  ast_arena::child_range children(ast_index parent) const noexcept;
+
+  // the top level blocks, in source order
+  ast_arena::child_range roots() const noexcept { return {roots_, roots_ + root_count_}; }
+
+ private:
+  friend class parse_cache;
+
+  cached_unit() = default;
+
+  // every index and range in the arrays is in bounds, and the tree under the roots is one
+  bool consistent(std::uint64_t content_size) const;
+
+  void* mapping_ = nullptr;  // or an owned buffer, where files can't be mapped
+  std::size_t mapping_size_ = 0;
+
+  std::size_t token_count_ = 0;
+  std::size_t node_count_ = 0;
+  std::size_t root_count_ = 0;
+  std::size_t child_count_ = 0;
+  std::size_t value_count_ = 0;
+  token_type const* kinds_ = nullptr;
+  std::uint32_t const* starts_ = nullptr;
+  std::uint32_t const* lengths_ = nullptr;
+  std::uint32_t const* value_indices_ = nullptr;  // of numerics into values_
+  std::uint64_t const* values_ = nullptr;
+  std::uint64_t const* errors_ = nullptr;
+  std::uint64_t const* negatives_ = nullptr;  // of numerics
+  ast_node const* nodes_ = nullptr;
+  ast_index const* children_ = nullptr;
+  ast_index const* roots_ = nullptr;
+};
+
+// Content addressed store of lexed and parsed files, one file per entry in a directory. Entries are keyed by a hash
+// of the text and the parser configuration, written atomically (rename), and shared between threads and processes.
+// An entry with another format version, byte order or size is a miss, and so is one that fails its checksum or
+// has an index or range out of bounds.
+class parse_cache {
+ public:
+  static const constexpr std::uint32_t format_version = 4;
+
+  // the directory is created if missing
+  explicit parse_cache(std::string directory);
+
+  static std::uint64_t key(std::string_view content, parser_context const& pc);
+
+  std::optional<cached_unit> find(std::uint64_t key, std::size_t content_size) const;
+
+  // false if the entry can't be written, the cache is only an optimization
+  bool store(std::uint64_t key, std::size_t content_size, token_buffer const& tokens, ast_arena const& arena,
+             std::vector<ast_index> const& roots) const;
+
+  std::string path(std::uint64_t key) const;
+
+ private:
+  std::string directory_;
+};
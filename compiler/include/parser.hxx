@@ -2,10 +2,20 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
 #include <set>
-#include <unordered_set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "ast.hxx"
+#include "expected.hxx"
+#include "hash.hxx"
+#include "instrument.hxx"
+#include "operator_trie.hxx"
+#include "symbol.hxx"
 #include "tokenizer.hxx"
 
 namespace {
@@ -14,64 +24,305 @@ bool has_newline(token const& t) {
 }
 }  // namespace
 
+inline constexpr std::array<std::string_view, 1> builtin_operators{"="};
+
+inline constexpr auto builtin_operator_table =
+    make_operator_table<operator_table_states(builtin_operators), operator_table_width(builtin_operators)>(
+        builtin_operators);
+
+// The values of a declared type: the width and signedness of the built-in integers, no bits for types that take any.
+struct integer_type {
+  std::uint8_t bits = 0;
+  bool is_signed = false;
+
+  // is the literal with this magnitude and sign a value of the type?
+  constexpr bool fits(std::uint64_t magnitude, bool negative) const noexcept {
+    if (bits == 0) {
+      return true;
+    }
+    if (!is_signed) {
+      return negative ? magnitude == 0 : bits == 64 || magnitude >> bits == 0;
+    }
+    const auto limit = std::uint64_t{1} << (bits - 1);
+    return negative ? magnitude <= limit : magnitude < limit;
+  }
+};
+
+inline constexpr std::array<std::pair<std::string_view, integer_type>, 8> builtin_integer_types{{
+    {"u8", {8, false}},
+    {"u16", {16, false}},
+    {"u32", {32, false}},
+    {"u64", {64, false}},
+    {"s8", {8, true}},
+    {"s16", {16, true}},
+    {"s32", {32, true}},
+    {"s64", {64, true}},
+}};
+
+// A scope: names are interned symbols, lookups walk the parent chain without allocating.
 class parser_context {
  public:
-  parser_context() {
-    operators_.insert("=");
-    types_.insert("u8");
-    types_.insert("u16");
-    types_.insert("u32");
-    types_.insert("u64");
-    types_.insert("s8");
-    types_.insert("s16");
-    types_.insert("s32");
-    types_.insert("s64");
+  // the root scope, with the built-in types and operators
+  parser_context() : parent_(nullptr), operator_trie_(builtin_operator_table) {
+    for (auto name : builtin_operators) {
+      operators_.insert(string_interner::global().intern(name));
+      operator_names_.emplace(name);
+    }
+    for (auto [name, type] : builtin_integer_types) {
+      declare_type(string_interner::global().intern(name), type);
+    }
+  }
+
+  // a nested scope
+  explicit parser_context(parser_context& parent) noexcept : parent_(&parent) {}
+
+  bool type_exists(symbol_id type) const noexcept { return find_type(type) != nullptr; }
+
+  bool type_exists(std::string_view typen) const noexcept {
+    return type_exists(string_interner::global().find(typen));
+  }
+
+  // the innermost declaration of the type, null if there is none
+  integer_type const* find_type(symbol_id type) const noexcept {
+    for (auto* pc = this; pc != nullptr; pc = pc->parent_) {
+      if (auto const* found = pc->types_.find(type)) {
+        return found;
+      }
+    }
+    return nullptr;
+  }
+
+  bool variable_exists(symbol_id variable) const noexcept {
+    return find_in_chain([variable](parser_context const& pc) { return pc.variables_.contains(variable); });
   }
 
-  bool type_exists(std::string_view typen) const noexcept { return types_.find(std::string{typen}) != types_.end(); }
+  bool operator_exists(symbol_id oper) const noexcept {
+    return find_in_chain([oper](parser_context const& pc) { return pc.operators_.contains(oper); });
+  }
 
   bool operator_or_prefix(std::string_view name) const noexcept {
-    auto it = std::lower_bound(operators_.begin(), operators_.end(), name);
-    return (it != operators_.end() && it->substr(0, name.length()) == name);
+    count_event(counter::operator_lookups);
+    return find_in_chain([name](parser_context const& pc) { return pc.operator_trie_.prefix(name); });
+  }
+
+  // The operator token at the start of text (see scan_operator), walking the tries of every scope with operators
+  // side by side, in one pass.
+  std::size_t operator_scan(std::string_view text) const noexcept {
+    count_event(counter::operator_lookups);
+    std::array<operator_trie const*, 8> tries;
+    std::array<operator_trie::state, 8> states;
+    std::size_t live = 0;
+    for (auto* pc = this; pc != nullptr; pc = pc->parent_) {
+      if (!pc->operator_trie_.empty()) {
+        if (live == tries.size()) {  // unusual, the prefix queries find the same
+          std::size_t length = 0;
+          return scan_operator(text, [&](char) { return operator_or_prefix(text.substr(0, ++length)); });
+        }
+        tries[live] = &pc->operator_trie_;
+        states[live++] = operator_trie::root;
+      }
+    }
+    return scan_operator(text, [&](char c) {
+      bool any = false;
+      for (std::size_t i = 0; i < live; ++i) {
+        states[i] = tries[i]->step(states[i], c);
+        any = any || states[i] != operator_trie::dead;
+      }
+      return any;
+    });
+  }
+
+  // Hash of the operators and types of the scope chain, by spelling: equal for equal configurations, across runs.
+  std::uint64_t fingerprint() const {
+    std::uint64_t h = 0;
+    for (auto* pc = this; pc != nullptr; pc = pc->parent_) {
+      for (auto const& name : pc->operator_names_) {
+        h = hash_combine(h, hash_bytes(name, 1));
+      }
+      std::vector<std::pair<std::string_view, integer_type>> types;
+      pc->types_.for_each([&types](symbol_id type, integer_type range) {
+        types.emplace_back(string_interner::global().name(type), range);
+      });
+      std::sort(types.begin(), types.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+      for (auto [type, range] : types) {
+        h = hash_combine(hash_combine(h, hash_bytes(type, 2)), range.bits * 2u + range.is_signed);
+      }
+      h = hash_combine(h, 3);  // the end of a scope
+    }
+    return h;
+  }
+
+  void declare_type(symbol_id type, integer_type range = {}) { types_.insert(type, range); }
+
+  void declare_variable(symbol_id variable) { variables_.insert(variable); }
+
+  void declare_operator(std::string_view name) {
+    operators_.insert(string_interner::global().intern(name));
+    if (operator_names_.emplace(name).second) {
+      operator_trie_.insert(name);
+    }
   }
 
  private:
-  parser_context* root_context_;
-  std::unordered_set<std::string> types_;
-  std::set<std::string> operators_;
-  std::unordered_set<std::string> variables_;
+  parser_context* parent_;
+  symbol_map<integer_type> types_;
+  symbol_set operators_;
+  symbol_set variables_;
+  std::set<std::string, std::less<>> operator_names_;  // by spelling, for the fingerprint
+  operator_trie operator_trie_;                          // the same, for prefix queries while lexing
+
+  template <typename F>
+  bool find_in_chain(F f) const noexcept {
+    for (auto* pc = this; pc != nullptr; pc = pc->parent_) {
+      if (f(*pc)) {
+        return true;
+      }
+    }
+    return false;
+  }
 };
 
+// Why a rule failed. The values are the codes the parser used to throw.
+enum class parse_errc : std::uint8_t {
+  wrong_text = 1,      // the token has the expected type, but not the expected text
+  wrong_token,         // a token of another type
+  invalid_token,       // the token has a lexical error
+  unknown_statement,   // an identifier that doesn't start a statement
+  unterminated_block,  // end of file inside a block
+  unexpected_token,    // a token that can't start a statement
+  value_out_of_range,  // a literal that isn't a value of the declared type
+};
+
+// The offending token, and its text: failed rules roll their tokens back, so the index can be gone when the error
+// is reported, the text stays until the tokenizer reads on.
+struct syntax_error {
+  parse_errc code;
+  std::uint32_t token;
+  std::uint32_t start;  // in content()
+  std::uint32_t length;
+};
+
+template <typename T>
+using parse_result = expected<T, syntax_error>;
+
+enum class parse_rule : std::uint8_t { block, decl_stmt, count };
+
+// Packrat memo: the outcome of every rule tried at a token, so backtracking never parses a region twice.
+// Outcomes don't depend on the enclosing scopes as long as only the root scope declares types and operators.
+// Only valid for one token stream. Parses with a memo keep the tokens and nodes of failed attempts, see the
+// checkpointers of the tokenizer and the arena.
+class parse_memo {
+ public:
+  struct entry {
+    bool tried = false;
+    ast_index node = no_node;  // no_node if the rule failed
+    std::uint32_t end = 0;     // the token after the rule
+    syntax_error error{};
+  };
+
+  entry const* find(parse_rule rule, std::size_t token) const noexcept {
+    const auto i = slot(rule, token);
+    return i < entries_.size() && entries_[i].tried ? &entries_[i] : nullptr;
+  }
+
+  void store(parse_rule rule, std::size_t token, entry e) {
+    const auto i = slot(rule, token);
+    if (i >= entries_.size()) {
+      entries_.resize(std::max(i + 1, entries_.size() * 2));
+    }
+    e.tried = true;
+    entries_[i] = e;
+  }
+
+  void clear() noexcept { entries_.clear(); }
+
+ private:
+  std::vector<entry> entries_;  // by token, then rule
+
+  static std::size_t slot(parse_rule rule, std::size_t token) noexcept {
+    return token * static_cast<std::size_t>(parse_rule::count) + static_cast<std::size_t>(rule);
+  }
+};
+
+// Runs parse for rule at the current token, unless the memo knows the outcome already: then the tokenizer is only
+// moved past a successful match.
+template <typename F>
+parse_result<ast_index> memoized(parse_memo* memo, tokenizer& t, parse_rule rule, F&& parse) {
+  if (memo == nullptr) {
+    return parse();
+  }
+  const auto start = t.cursor();
+  if (auto const* e = memo->find(rule, start)) {
+    if (e->node == no_node) {
+      return unexpected{e->error};
+    }
+    if (e->end <= t.tokens().size()) {  // unless the tokens were rolled back by a parse without the memo
+      t.seek(e->end);
+      return e->node;
+    }
+  }
+  const auto result = parse();
+  if (result) {
+    memo->store(rule, start, {true, *result, static_cast<std::uint32_t>(t.cursor()), {}});
+  } else {
+    memo->store(rule, start, {true, no_node, 0, result.error()});
+  }
+  return result;
+}
+
 class parser_base {
  public:
-  // descendant destructors will either commit or throw
-  parser_base(parser_context& pc, tokenizer& t) noexcept : tokenizer_(t), checkpoint_(tokenizer_), pc_(pc) {}
+  // descendants commit on success, anything else is rolled back when they are destroyed
+  parser_base(parser_context& pc, tokenizer& t, ast_arena& arena, parse_memo* memo) noexcept
+      : tokenizer_(t)
+      , checkpoint_(tokenizer_, memo != nullptr)
+      , arena_(arena)
+      , arena_checkpoint_(arena_, memo != nullptr)
+      , pc_(pc)
+      , operator_scanner_{tokenizer::scan_t::bind<&parser_context::operator_scan>(pc_)}
+      , memo_(memo) {}
 
  protected:
   tokenizer& tokenizer_;
   tokenizer::checkpointer checkpoint_;
+  ast_arena& arena_;
+  ast_arena::checkpointer arena_checkpoint_;
   parser_context& pc_;
+  tokenizer::operator_scanner operator_scanner_;
+  parse_memo* memo_;
+
+  token next_token() noexcept { return tokenizer_.next_token(operator_scanner_); }
+
+  // index of the token returned last
+  std::uint32_t last_token() const noexcept { return static_cast<std::uint32_t>(tokenizer_.cursor() - 1); }
+
+  void commit() noexcept {
+    checkpoint_.commit();
+    arena_checkpoint_.commit();
+  }
 
-  token const& next_token() noexcept {
-    return tokenizer_.next_token([this](std::string_view sv) { return pc_.operator_or_prefix(sv); });
+  // an error at the token returned last
+  unexpected<syntax_error> fail(parse_errc code) const noexcept {
+    const auto i = last_token();
+    return unexpected{syntax_error{code, i, tokenizer_.tokens().start(i), tokenizer_.tokens().length(i)}};
   }
 
-  token const& require_token_allow_ws(token_type tt) {
+  parse_result<token> require_token_allow_ws(token_type tt) noexcept {
     tokenizer_.skip_whitespace();
     auto const& tok = next_token();
     if (tok.type != tt) {
-      throw 2;
+      return fail(parse_errc::wrong_token);
     }
     if (tok.error) {
-      throw 3;
+      return fail(parse_errc::invalid_token);
     }
     return tok;
   }
 
-  token const& require_token_allow_ws(token_type tt, std::string_view text) {
-    auto const& tok = require_token_allow_ws(tt);
-    if (tok.text != text) {
-      throw 1;
+  parse_result<token> require_token_allow_ws(token_type tt, std::string_view text) noexcept {
+    const auto tok = require_token_allow_ws(tt);
+    if (tok && tok->text != text) {
+      return fail(parse_errc::wrong_text);
     }
     return tok;
   }
@@ -79,7 +330,25 @@ class parser_base {
 
 class parser_block : private parser_context, public parser_base {
  public:
-  parser_block(tokenizer& t) : parser_base(*this, t) {
+  // A top level block, in a root scope. The opening bracket was read already.
+  // With a memo, blocks and statements already tried at a token are not parsed again.
+  static parse_result<ast_index> parse(tokenizer& t, ast_arena& arena, parse_memo* memo = nullptr) {
+    return memoized(memo, t, parse_rule::block, [&] { return parser_block{t, arena, memo}.parse_body(); });
+  }
+
+  // a nested block, names of the enclosing scopes are visible
+  static parse_result<ast_index> parse(parser_context& parent, tokenizer& t, ast_arena& arena,
+                                       parse_memo* memo = nullptr) {
+    return memoized(memo, t, parse_rule::block, [&] { return parser_block{parent, t, arena, memo}.parse_body(); });
+  }
+
+ private:
+  parser_block(tokenizer& t, ast_arena& arena, parse_memo* memo) noexcept : parser_base(*this, t, arena, memo) {}
+
+  parser_block(parser_context& parent, tokenizer& t, ast_arena& arena, parse_memo* memo) noexcept
+      : parser_context(parent), parser_base(*this, t, arena, memo) {}
+
+  parse_result<ast_index> parse_body() {
     // assert: current token is a block opener
 
     // if (something) {}
@@ -96,11 +365,12 @@ class parser_block : private parser_context, public parser_base {
     // tt v(a, b,
     //      c)
 
-    ast_block a_b;
+    const auto children = arena_.open_children();
+    const auto node = arena_.add({ast_kind::block, last_token(), last_token(), 0, 0});
 
     bool block_end = false;
     while (!block_end) {
-      t.skip_whitespace();
+      tokenizer_.skip_whitespace();
       auto const& tok = next_token();
       switch (tok.type) {
         case token_type::bracket:
@@ -108,6 +378,14 @@ class parser_block : private parser_context, public parser_base {
             block_end = true;
             break;
           }
+          if (tok.text == "{") {
+            const auto nested = parse(*this, tokenizer_, arena_, memo_);
+            if (!nested) {
+              return unexpected{nested.error()};
+            }
+            arena_.push_child(*nested);
+            break;
+          }
           break;
         case token_type::function_identifier:
           // start of a function call
@@ -115,30 +393,63 @@ class parser_block : private parser_context, public parser_base {
           // has to be a type, keyword, or function call
 
           // if it is a type, this has to be a variable declaration statement
-          if (pc_.type_exists(tok.text)) {
-            // assume a variable declaration: <type> <name> = <integer_value>
-            // require_token(token_type::identifier);
-            require_token_allow_ws(token_type::identifier);
-            require_token_allow_ws(token_type::oper, "=");
-            require_token_allow_ws(token_type::numeric);
-            const auto maybe_ws = t.skip_whitespace();
-            if (maybe_ws && has_newline(*maybe_ws)) {
-              // found a statement end!
-              break;
-            } else {
-              require_token_allow_ws(token_type::semicolon);
-              break;
+          if (pc_.type_exists(tok.symbol)) {
+            const auto decl = memoized(memo_, tokenizer_, parse_rule::decl_stmt, [this] { return parse_decl(); });
+            if (!decl) {
+              return unexpected{decl.error()};
             }
+            declare_variable(tokenizer_.tokens().symbol(arena_[*decl].lhs));
+            arena_.push_child(*decl);
+            break;
           }
-          throw 4;
-          break;
+          return fail(parse_errc::unknown_statement);
         }
-        default:
-          // error :(
+        case token_type::semicolon:
+          // empty statement
           break;
+        case token_type::eof:
+          return fail(parse_errc::unterminated_block);
+        default:
+          return fail(parse_errc::unexpected_token);
       }
     }
+
+    arena_.close_children(node, children);
+    arena_[node].last_token = last_token();
+    commit();
+    return node;
   }
 
- private:
+  // the rest of a variable declaration after its type: <name> = <integer_value>, up to the statement end
+  parse_result<ast_index> parse_decl() {
+    const auto type_token = last_token();
+    const auto name = require_token_allow_ws(token_type::identifier);
+    if (!name) {
+      return unexpected{name.error()};
+    }
+    const auto name_token = last_token();
+    if (const auto oper = require_token_allow_ws(token_type::oper, "="); !oper) {
+      return unexpected{oper.error()};
+    }
+    const auto value = require_token_allow_ws(token_type::numeric);
+    if (!value) {
+      return unexpected{value.error()};
+    }
+    // decoded with its sign by the tokenizer, the text isn't read again
+    const auto* type = pc_.find_type(tokenizer_.tokens().symbol(type_token));
+    if (type != nullptr && !type->fits(value->value, value->negative)) {
+      return fail(parse_errc::value_out_of_range);
+    }
+    const auto value_token = last_token();
+    const auto node = arena_.add({ast_kind::decl_stmt, type_token, value_token, name_token, value_token});
+    const auto maybe_ws = tokenizer_.skip_whitespace();
+    if (maybe_ws && has_newline(*maybe_ws)) {
+      // found a statement end!
+      return node;
+    }
+    if (const auto end = require_token_allow_ws(token_type::semicolon); !end) {
+      return unexpected{end.error()};
+    }
+    return node;
+  }
 };
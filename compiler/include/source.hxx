@@ -1,9 +1,19 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 
+namespace spdlog {
+class logger;
+}
+
 struct source_pos {
   int line;
   int offset;
@@ -14,6 +24,26 @@ struct source_range {
   source_pos end;
 };
 
+// Maps byte offsets to line / column, built with a single newline pass over the text.
+// Edits are patched in: the lines behind the last edit are kept apart, the last one first, with starts relative to
+// a shared shift, so an edit only moves the lines between it and the last one.
+class line_index {
+ public:
+  explicit line_index(std::string_view text);
+
+  source_pos position(std::uint32_t offset) const noexcept;
+
+  // length bytes at offset were replaced by replacement
+  void apply_edit(std::uint32_t offset, std::uint32_t length, std::string_view replacement);
+
+  std::size_t line_count() const noexcept { return line_starts_.size() + tail_starts_.size(); }
+
+ private:
+  std::vector<std::uint32_t> line_starts_;
+  std::vector<std::uint32_t> tail_starts_;  // behind the gap, the last line first, without tail_shift_
+  std::uint32_t tail_shift_ = 0;
+};
+
 enum class diagnostic_level { warning, error };
 
 class diagnostic_message {
@@ -24,20 +54,79 @@ class diagnostic_message {
   virtual ~diagnostic_message(){};
 };
 
+// Locations are resolved by the reporter, the texts are only formatted when the diagnostic is rendered.
 struct source_diagnostic {
   const diagnostic_message& diag;
   source_range where;
-  std::string suggestion;
+  std::string_view suggestion;  // not copied, has to outlive the reporter
+};
+
+struct diagnostic_limits {
+  std::size_t max_errors = 1000;   // errors after this are only counted
+  std::size_t max_per_code = 100;  // the same for each diagnostic code, errors and warnings alike
 };
 
+// Concurrent sink: the limits are checked with atomic counters, and every thread appends to its own buffer, whose
+// lock is only contended while the buffers are read and merged. Diagnostics over the limits are counted but not
+// stored, so broken inputs can't grow it without bounds.
 class diagnostic_reporter {
  public:
   using messages_t = std::vector<source_diagnostic>;
 
-  void report(source_diagnostic diag);
+  explicit diagnostic_reporter(diagnostic_limits limits = {});
+  diagnostic_reporter(diagnostic_reporter&& other) noexcept;  // only while no other thread uses either of them
+  diagnostic_reporter& operator=(diagnostic_reporter&&) = delete;
+  ~diagnostic_reporter();
+
+  void report(source_diagnostic diag) {
+    if (admit(diag.diag)) {
+      store(diag);
+    }
+  }
+
+  // locate() -> source_range is only called if the diagnostic is stored
+  template <typename F>
+  void report(diagnostic_message const& diag, F&& locate, std::string_view suggestion = {}) {
+    if (admit(diag)) {
+      store({diag, locate(), suggestion});
+    }
+  }
+
+  // every stored diagnostic, ordered by location then code, exact duplicates dropped
+  messages_t messages() const;
+
+  std::size_t error_count() const noexcept { return errors_.load(std::memory_order_relaxed); }
 
-  messages_t const& messages() const;
+  // past the error cap errors are only counted, without building or reporting them
+  bool error_cap_reached() const noexcept { return error_count() >= limits_.max_errors; }
+  void count_suppressed_error() noexcept {
+    errors_.fetch_add(1, std::memory_order_relaxed);
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // reported but not stored
+  std::size_t suppressed() const noexcept { return suppressed_.load(std::memory_order_relaxed); }
+
+  // writes the messages, and a line about the suppressed ones, to the diagnostics logger (stderr)
+  void render(std::string_view path) const;
+  void render(spdlog::logger& log, std::string_view path) const;
 
  private:
-  messages_t messages_;
+  struct thread_buffer;
+
+  static constexpr std::size_t code_slots = 256;  // codes outside [0, code_slots) share the last slot
+
+  diagnostic_limits limits_;
+  std::uint64_t id_;  // identifies the reporter in the per-thread buffer caches
+  mutable std::mutex buffers_mutex_;
+  std::vector<std::unique_ptr<thread_buffer>> buffers_;
+  std::atomic<std::size_t> errors_{0};
+  std::atomic<std::size_t> suppressed_{0};
+  std::array<std::atomic<std::size_t>, code_slots> per_code_{};
+
+  // counts the diagnostic, returns whether it fits in the limits
+  bool admit(diagnostic_message const& diag) noexcept;
+  void store(source_diagnostic const& diag);
+  thread_buffer& local_buffer();
+  static std::size_t code_slot(int code) noexcept;
 };
@@ -0,0 +1,62 @@
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+using file_id = std::uint32_t;
+
+// Owns or borrows the text of every source file, and hands out stable, read-only views.
+// Views stay valid until the manager is destroyed. Files can be added and read from several threads.
+class source_manager {
+ public:
+  source_manager() = default;
+  source_manager(source_manager const&) = delete;
+  source_manager& operator=(source_manager const&) = delete;
+  ~source_manager();
+
+  // token offsets are 32 bit, larger files are rejected
+  static const constexpr std::uint64_t max_file_size = UINT32_MAX;
+
+  // maps the file read-only, throws std::system_error if it can't be read, with std::errc::file_too_large if it is
+  // larger than max_file_size
+  file_id load_file(std::string const& path);
+
+  // the caller keeps the buffer alive and unchanged while the manager exists
+  file_id add_buffer(std::string name, std::string_view content);
+
+  file_id add_owned_buffer(std::string name, std::string content);
+
+  std::string_view name(file_id file) const noexcept {
+    std::lock_guard lock(mutex_);
+    return files_[file].name;
+  }
+
+  std::string_view content(file_id file) const noexcept {
+    std::lock_guard lock(mutex_);
+    return files_[file].content;
+  }
+
+  std::size_t file_count() const noexcept {
+    std::lock_guard lock(mutex_);
+    return files_.size();
+  }
+
+ private:
+  struct source_file {
+    std::string name;
+    std::string_view content;
+    std::string owned;  // only for owned buffers
+    void* mapping = nullptr;
+    std::size_t mapping_size = 0;
+  };
+
+  // deque: adding a file never moves the existing ones
+  std::deque<source_file> files_;
+  mutable std::mutex mutex_;
+
+  file_id add(source_file file);
+};
@@ -0,0 +1,66 @@
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded single producer, single consumer queue without locks. Each side owns one index and publishes it with a
+// release store; the other side's index is cached and only reloaded when the queue looks full or empty, so the two
+// threads share a cache line only then.
+template <typename T>
+class spsc_queue {
+ public:
+  // the capacity is rounded up to a power of two
+  explicit spsc_queue(std::size_t capacity) : slots_(round_up(capacity)), mask_(slots_.size() - 1) {}
+  spsc_queue(spsc_queue const&) = delete;
+  spsc_queue& operator=(spsc_queue const&) = delete;
+
+  std::size_t capacity() const noexcept { return slots_.size(); }
+
+  // producer only, false if the queue is full
+  bool try_push(T const& value) noexcept {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ == slots_.size()) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ == slots_.size()) {
+        return false;
+      }
+    }
+    slots_[tail & mask_] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer only, false if the queue is empty
+  bool try_pop(T& value) noexcept {
+    const auto head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) {
+        return false;
+      }
+    }
+    value = slots_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  static constexpr std::size_t cache_line = 64;
+
+  std::vector<T> slots_;
+  std::size_t mask_;
+  alignas(cache_line) std::atomic<std::size_t> head_{0};  // written by the consumer
+  std::size_t tail_cache_ = 0;                           // the consumer's copy of tail_
+  alignas(cache_line) std::atomic<std::size_t> tail_{0};  // written by the producer
+  std::size_t head_cache_ = 0;                           // the producer's copy of head_
+
+  static std::size_t round_up(std::size_t n) noexcept {
+    std::size_t capacity = 1;
+    while (capacity < n) {
+      capacity *= 2;
+    }
+    return capacity;
+  }
+};
@@ -0,0 +1,133 @@
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+// interned identifier, equal spellings get equal ids
+using symbol_id = std::uint32_t;
+
+inline constexpr symbol_id no_symbol = 0;
+
+// Turns strings into dense symbol ids. Thread safe, the interned text is never moved or freed.
+class string_interner {
+ public:
+  string_interner();
+  string_interner(string_interner const&) = delete;
+  string_interner& operator=(string_interner const&) = delete;
+
+  symbol_id intern(std::string_view text);
+
+  // no_symbol if the text was never interned
+  symbol_id find(std::string_view text) const noexcept;
+
+  std::string_view name(symbol_id id) const noexcept;
+
+  std::size_t size() const noexcept;
+
+  static string_interner& global();
+
+ private:
+  struct entry {
+    std::string_view text;
+    std::size_t hash;
+  };
+
+  mutable std::shared_mutex mutex_;
+  std::vector<entry> entries_;  // by id, entry 0 is no_symbol
+  std::vector<symbol_id> slots_;  // open addressing, no_symbol is empty
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  std::size_t chunk_used_;
+  std::size_t chunk_size_;
+
+  symbol_id lookup(std::string_view text, std::size_t hash) const noexcept;
+  std::string_view store(std::string_view text);
+  void grow();
+};
+
+// Flat open addressing hash map keyed by symbol id. Lookups don't allocate.
+template <typename T>
+class symbol_map {
+ public:
+  T const* find(symbol_id id) const noexcept {
+    if (size_ == 0 || id == no_symbol) {
+      return nullptr;
+    }
+    for (auto i = slot(id);; i = (i + 1) & (keys_.size() - 1)) {
+      if (keys_[i] == id) {
+        return &values_[i];
+      }
+      if (keys_[i] == no_symbol) {
+        return nullptr;
+      }
+    }
+  }
+
+  bool contains(symbol_id id) const noexcept { return find(id) != nullptr; }
+
+  // returns false if the id was already present, the stored value is kept then
+  bool insert(symbol_id id, T value = T{}) {
+    if (id == no_symbol) {
+      return false;
+    }
+    if ((size_ + 1) * 2 > keys_.size()) {
+      rehash(keys_.empty() ? 16 : keys_.size() * 2);
+    }
+    return place(id, std::move(value));
+  }
+
+  std::size_t size() const noexcept { return size_; }
+
+  // f(id, value) for every entry, in no particular order
+  template <typename F>
+  void for_each(F&& f) const {
+    for (std::size_t i = 0; i < keys_.size(); ++i) {
+      if (keys_[i] != no_symbol) {
+        f(keys_[i], values_[i]);
+      }
+    }
+  }
+
+ private:
+  std::vector<symbol_id> keys_;
+  std::vector<T> values_;
+  std::size_t size_ = 0;
+
+  std::size_t slot(symbol_id id) const noexcept {
+    // fibonacci hashing spreads the dense ids over the table
+    return static_cast<std::size_t>((id * 0x9E3779B97F4A7C15ull) >> 32) & (keys_.size() - 1);
+  }
+
+  bool place(symbol_id id, T&& value) {
+    for (auto i = slot(id);; i = (i + 1) & (keys_.size() - 1)) {
+      if (keys_[i] == id) {
+        return false;
+      }
+      if (keys_[i] == no_symbol) {
+        keys_[i] = id;
+        values_[i] = std::move(value);
+        ++size_;
+        return true;
+      }
+    }
+  }
+
+  void rehash(std::size_t capacity) {
+    auto old_keys = std::move(keys_);
+    auto old_values = std::move(values_);
+    keys_.assign(capacity, no_symbol);
+    values_.assign(capacity, T{});
+    size_ = 0;
+    for (std::size_t i = 0; i < old_keys.size(); ++i) {
+      if (old_keys[i] != no_symbol) {
+        place(old_keys[i], std::move(old_values[i]));
+      }
+    }
+  }
+};
+
+// the mapped byte is unused, not bool because of std::vector<bool>
+using symbol_set = symbol_map<std::uint8_t>;
@@ -0,0 +1,62 @@
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed size pool with one task deque per worker. Workers take their own tasks from the back,
+// and steal from the front of the other deques when they run out. Submitting and taking only lock the deques, the
+// pool's mutex is only taken to put idle workers to sleep and wake them, and to wait for the end.
+class thread_pool {
+ public:
+  using task_t = std::function<void()>;
+
+  // 0 threads: one per hardware thread
+  explicit thread_pool(std::size_t threads = 0);
+  thread_pool(thread_pool const&) = delete;
+  thread_pool& operator=(thread_pool const&) = delete;
+  ~thread_pool();
+
+  // from a worker the task goes to its own deque, otherwise the deques are filled round robin
+  void submit(task_t task);
+
+  // blocks until every submitted task finished
+  void wait();
+
+  std::size_t size() const noexcept { return threads_.size(); }
+
+  // index of the calling worker in its pool, or npos outside of pools
+  static std::size_t current_worker() noexcept;
+
+  static const constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+ private:
+  struct task_queue {
+    std::mutex mutex;
+    std::deque<task_t> tasks;
+  };
+
+  std::vector<std::unique_ptr<task_queue>> queues_;
+  std::vector<std::thread> threads_;
+
+  std::atomic<std::size_t> queued_{0};      // tasks in the deques, changed under the lock of the deque
+  std::atomic<std::size_t> unfinished_{0};  // queued or running
+  std::atomic<std::size_t> sleeping_{0};    // workers waiting for work
+
+  std::mutex state_mutex_;  // for the condition variables only
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  bool stop_ = false;  // guarded by state_mutex_
+  std::atomic<std::size_t> next_queue_{0};
+
+  void run(std::size_t index);
+  bool try_take(std::size_t index, task_t& task);
+  // false once the pool stops and every deque is empty
+  bool sleep_until_work();
+};
@@ -0,0 +1,370 @@
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "symbol.hxx"
+
+// a numeric literal: its magnitude, and whether it starts with '-'
+struct numeric_value {
+  std::uint64_t magnitude;
+  bool negative;
+};
+
+enum class token_type : std::uint8_t {
+  unknown,
+  bracket,
+  semicolon,
+  whitespace,
+  oper,
+  identifier,
+  function_identifier,
+  numeric,
+  eof
+};
+
+// Struct-of-arrays storage of lexed tokens: 1 byte of kind, 32 bit start offset and length, 1 bit of error,
+// and a 32 bit payload: the interned symbol of identifiers. The decoded values of numerics (see tokenizer), with
+// their sign, are kept in a side table, the payload of a numeric is its index there.
+// Positions are byte offsets into the source, lines and columns are resolved on demand.
+// Indices are stable: after release the stored tokens are [first(), size()), the older ones are gone.
+// Edits (splice) go through a gap in the arrays, at the last edit. The starts behind it are relative to a shared
+// shift, so an edit costs a memmove of the tokens between it and the last one, not of the rest of the file.
+// Appending closes the gap.
+class token_buffer {
+ public:
+  std::size_t size() const noexcept { return first_ + kinds_.size() - gap_length_; }
+  bool empty() const noexcept { return size() == 0; }
+
+  // the oldest stored token
+  std::size_t first() const noexcept { return first_; }
+
+  // the tokens from here on are behind the gap, size() if there is none
+  std::size_t gap() const noexcept { return gap_at_ == no_gap ? size() : gap_at_; }
+
+  token_type kind(std::size_t i) const noexcept { return kinds_[at(i)]; }
+  std::uint32_t start(std::size_t i) const noexcept {
+    return i < gap_at_ ? starts_[i - first_] : starts_[i - first_ + gap_length_] + tail_shift_;
+  }
+  std::uint32_t length(std::size_t i) const noexcept { return lengths_[at(i)]; }
+  std::uint32_t end(std::size_t i) const noexcept { return start(i) + length(i); }
+  bool error(std::size_t i) const noexcept {
+    const auto p = at(i);
+    return (errors_[p / 64] >> (p % 64)) & 1u;
+  }
+  symbol_id symbol(std::size_t i) const noexcept { return payloads_[at(i)]; }
+  std::uint64_t value(std::size_t i) const noexcept { return numeric(i).magnitude; }
+  bool negative(std::size_t i) const noexcept { return numeric(i).negative; }
+  numeric_value numeric(std::size_t i) const noexcept {
+    const auto p = at(i);
+    return kinds_[p] == token_type::numeric ? values_[payloads_[p]] : numeric_value{0, false};
+  }
+
+  // the payload is the symbol of identifiers, the magnitude of numerics
+  void push_back(token_type kind, std::uint32_t start, std::uint32_t length, bool error,
+                 std::uint64_t payload = 0, bool negative = false) {
+    if (gap_at_ != no_gap) {
+      close_gap();
+    }
+    const auto i = kinds_.size();
+    if (i % 64 == 0) {
+      errors_.push_back(0);
+    }
+    errors_[i / 64] |= std::uint64_t{error} << (i % 64);
+    kinds_.push_back(kind);
+    starts_.push_back(start);
+    lengths_.push_back(length);
+    payloads_.push_back(kind == token_type::numeric ? add_value({payload, negative})
+                                                    : static_cast<std::uint32_t>(payload));
+  }
+
+  // drops every token from index count on
+  void truncate(std::size_t count) noexcept {
+    if (count >= size()) {
+      return;
+    }
+    drop_values(count, size());
+    if (gap_at_ != no_gap) {
+      if (count > gap_at_) {
+        move_gap(count);
+      }
+      reset_gap();
+    }
+    resize_columns(count - first_);
+  }
+
+  // Drops the tokens before index count, and moves the starts of the rest back by text_shift, when the text
+  // before them was dropped too. Costs a move of the stored tokens.
+  void release(std::size_t count, std::uint32_t text_shift) {
+    close_gap();
+    count = std::clamp(count, first_, size()) - first_;
+    const auto kept = kinds_.size() - count;
+    std::vector<std::uint64_t> errors((kept + 63) / 64);
+    copy_bits(errors_, count, errors, 0, kept);
+    errors_.swap(errors);
+
+    const auto drop = [count](auto& v) { v.erase(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(count)); };
+    drop(kinds_);
+    drop(starts_);
+    drop(lengths_);
+    drop(payloads_);
+    first_ += count;
+    for (auto& s : starts_) {
+      s -= text_shift;
+    }
+    compact_values();
+  }
+
+  // Replaces tokens [first, last) with the tokens of fresh, and moves the starts of the following ones by shift
+  // (nothing may have been released). Costs the tokens of fresh, and a memmove of those between last and the gap;
+  // when the gap is too small for fresh, it is widened by a memmove of the tokens behind it. The value table is
+  // compacted once the values of replaced numerics outnumber the live ones.
+  void splice(std::size_t first, std::size_t last, token_buffer const& fresh, std::int64_t shift) {
+    drop_values(first, last);
+    move_gap(last);
+    gap_at_ = first;
+    gap_length_ += last - first;
+    if (gap_length_ < fresh.size()) {
+      widen_gap(fresh.size() - gap_length_ + size() / 64 + 64);
+    }
+    for (std::size_t i = 0; i < fresh.size(); ++i) {
+      const auto p = gap_at_ - first_ + i;
+      kinds_[p] = fresh.kind(i);
+      starts_[p] = fresh.start(i);
+      lengths_[p] = fresh.length(i);
+      payloads_[p] = fresh.kind(i) == token_type::numeric ? add_value(fresh.numeric(i)) : fresh.symbol(i);
+      errors_[p / 64] = (errors_[p / 64] & ~(std::uint64_t{1} << (p % 64))) |
+                        (std::uint64_t{fresh.error(i)} << (p % 64));
+    }
+    gap_at_ += fresh.size();
+    gap_length_ -= fresh.size();
+    tail_shift_ += static_cast<std::uint32_t>(shift);
+    if (gap_at_ == size()) {
+      close_gap();  // nothing behind it
+    }
+    if (dead_values_ > 64 && dead_values_ > values_.size() / 2) {
+      compact_values();
+    }
+  }
+
+  // appends the first count tokens of other, with their starts moved by shift (other has released nothing)
+  void append(token_buffer const& other, std::size_t count, std::uint32_t shift) {
+    close_gap();
+    if (other.gap() < count) {
+      for (std::size_t i = 0; i < count; ++i) {
+        const auto numeric = other.kind(i) == token_type::numeric;
+        push_back(other.kind(i), other.start(i) + shift, other.length(i), other.error(i),
+                  numeric ? other.value(i) : other.symbol(i), other.negative(i));
+      }
+      return;
+    }
+    const auto at = kinds_.size();
+    const auto end = [count](auto const& v) { return v.begin() + static_cast<std::ptrdiff_t>(count); };
+    kinds_.insert(kinds_.end(), other.kinds_.begin(), end(other.kinds_));
+    lengths_.insert(lengths_.end(), other.lengths_.begin(), end(other.lengths_));
+    payloads_.insert(payloads_.end(), other.payloads_.begin(), end(other.payloads_));
+    starts_.resize(at + count);
+    std::transform(other.starts_.begin(), end(other.starts_), starts_.begin() + static_cast<std::ptrdiff_t>(at),
+                   [shift](std::uint32_t s) { return s + shift; });
+    errors_.resize((at + count + 63) / 64);
+    copy_bits(other.errors_, 0, errors_, at, count);
+    for (auto p = at; p < kinds_.size(); ++p) {
+      if (kinds_[p] == token_type::numeric) {
+        payloads_[p] = add_value(other.values_[payloads_[p]]);
+      }
+    }
+  }
+
+  // moves the gap to the end and drops it, a memmove of the tokens behind it
+  void close_gap() {
+    if (gap_at_ == no_gap) {
+      return;
+    }
+    move_gap(size());
+    const auto count = gap_at_ - first_;
+    reset_gap();
+    resize_columns(count);
+  }
+
+  // the stored columns, from first() on, for serialization: only without a gap
+  std::vector<token_type> const& kind_column() const noexcept { return kinds_; }
+  std::vector<std::uint32_t> const& start_column() const noexcept { return starts_; }
+  std::vector<std::uint32_t> const& length_column() const noexcept { return lengths_; }
+  std::vector<std::uint64_t> const& error_words() const noexcept { return errors_; }
+
+  void reserve(std::size_t count) {
+    kinds_.reserve(count);
+    starts_.reserve(count);
+    lengths_.reserve(count);
+    payloads_.reserve(count);
+    errors_.reserve((count + 63) / 64);
+  }
+
+  // bytes held by the arrays
+  std::size_t memory_usage() const noexcept {
+    return kinds_.capacity() * sizeof(token_type) +
+           (starts_.capacity() + lengths_.capacity() + payloads_.capacity()) * sizeof(std::uint32_t) +
+           errors_.capacity() * sizeof(std::uint64_t) + values_.capacity() * sizeof(numeric_value);
+  }
+
+ private:
+  static constexpr std::size_t no_gap = ~std::size_t{0};
+
+  // the position of token i in the arrays
+  std::size_t at(std::size_t i) const noexcept { return i - first_ + (i < gap_at_ ? 0 : gap_length_); }
+
+  void reset_gap() noexcept {
+    gap_at_ = no_gap;
+    gap_length_ = 0;
+    tail_shift_ = 0;
+  }
+
+  std::uint32_t add_value(numeric_value value) {
+    values_.push_back(value);
+    return static_cast<std::uint32_t>(values_.size() - 1);
+  }
+
+  // The values of the numerics [from, to) are dropped: right away if they are the last ones of the table, as after
+  // lexing, otherwise they are only counted, until compact_values.
+  void drop_values(std::size_t from, std::size_t to) noexcept {
+    std::size_t count = 0;
+    auto lowest = values_.size();
+    for (auto i = from; i < to; ++i) {
+      const auto p = at(i);
+      if (kinds_[p] == token_type::numeric) {
+        ++count;
+        lowest = std::min<std::size_t>(lowest, payloads_[p]);
+      }
+    }
+    if (lowest + count == values_.size()) {
+      values_.resize(lowest);
+    } else {
+      dead_values_ += count;
+    }
+  }
+
+  // rebuilds the value table in token order, without dropped values
+  void compact_values() {
+    std::vector<numeric_value> values;
+    values.reserve(values_.size() - dead_values_);
+    for (auto i = first_; i < size(); ++i) {
+      const auto p = at(i);
+      if (kinds_[p] == token_type::numeric) {
+        values.push_back(values_[payloads_[p]]);
+        payloads_[p] = static_cast<std::uint32_t>(values.size() - 1);
+      }
+    }
+    values_.swap(values);
+    dead_values_ = 0;
+  }
+
+  // keeps the first count entries of the arrays
+  void resize_columns(std::size_t count) noexcept {
+    kinds_.resize(count);
+    starts_.resize(count);
+    lengths_.resize(count);
+    payloads_.resize(count);
+    errors_.resize((count + 63) / 64);
+    if (count % 64 != 0) {
+      errors_.back() &= (std::uint64_t{1} << (count % 64)) - 1;
+    }
+  }
+
+  // moves the gap to index to: the tokens in between cross it, and their starts are made relative or absolute
+  void move_gap(std::size_t to) {
+    if (gap_at_ == no_gap) {
+      gap_at_ = size();
+    }
+    const auto gap = gap_at_ - first_;
+    const auto target = to - first_;
+    if (target < gap) {
+      move_columns(target, gap, target + gap_length_);
+      for (auto p = target + gap_length_; p < gap + gap_length_; ++p) {
+        starts_[p] -= tail_shift_;
+      }
+    } else if (target > gap) {
+      move_columns(gap + gap_length_, target + gap_length_, gap);
+      for (auto p = gap; p < target; ++p) {
+        starts_[p] += tail_shift_;
+      }
+    }
+    gap_at_ = to;
+  }
+
+  // inserts count unused entries at the end of the gap
+  void widen_gap(std::size_t count) {
+    const auto behind = gap_at_ - first_ + gap_length_;
+    const auto tail = kinds_.size() - behind;
+    std::vector<std::uint64_t> tail_errors((tail + 63) / 64);
+    copy_bits(errors_, behind, tail_errors, 0, tail);
+    const auto widen = [behind, count](auto& v) {
+      v.insert(v.begin() + static_cast<std::ptrdiff_t>(behind), count, {});
+    };
+    widen(kinds_);
+    widen(starts_);
+    widen(lengths_);
+    widen(payloads_);
+    errors_.resize((kinds_.size() + 63) / 64);
+    copy_bits(tail_errors, 0, errors_, behind + count, tail);
+    gap_length_ += count;
+  }
+
+  // moves the entries [from, to) of the arrays to dest, a memmove
+  void move_columns(std::size_t from, std::size_t to, std::size_t dest) {
+    const auto move = [from, to, dest](auto& v) {
+      const auto at = [&v](std::size_t i) { return v.begin() + static_cast<std::ptrdiff_t>(i); };
+      if (dest < from) {
+        std::move(at(from), at(to), at(dest));
+      } else {
+        std::move_backward(at(from), at(to), at(dest + (to - from)));
+      }
+    };
+    move(kinds_);
+    move(starts_);
+    move(lengths_);
+    move(payloads_);
+    std::vector<std::uint64_t> bits((to - from + 63) / 64);
+    copy_bits(errors_, from, bits, 0, to - from);
+    copy_bits(bits, 0, errors_, dest, to - from);
+  }
+
+  // copies count bits, 64 at a time
+  static void copy_bits(std::vector<std::uint64_t> const& src, std::size_t src_pos, std::vector<std::uint64_t>& dst,
+                        std::size_t dst_pos, std::size_t count) {
+    for (std::size_t done = 0; done < count; done += 64) {
+      const auto n = std::min<std::size_t>(64, count - done);
+      const auto mask = n == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << n) - 1;
+
+      const auto sp = src_pos + done;
+      auto bits = src[sp / 64] >> (sp % 64);
+      if (sp % 64 != 0 && sp / 64 + 1 < src.size()) {
+        bits |= src[sp / 64 + 1] << (64 - sp % 64);
+      }
+      bits &= mask;
+
+      const auto dp = dst_pos + done;
+      auto& lo = dst[dp / 64];
+      lo = (lo & ~(mask << (dp % 64))) | (bits << (dp % 64));
+      if (dp % 64 != 0 && dp % 64 + n > 64) {
+        auto& hi = dst[dp / 64 + 1];
+        hi = (hi & ~(mask >> (64 - dp % 64))) | (bits >> (64 - dp % 64));
+      }
+    }
+  }
+
+  // the arrays hold the tokens before the gap, gap_length_ unused entries, then the tokens behind it, whose starts
+  // are stored without tail_shift_ (modulo 2^32)
+  std::vector<token_type> kinds_;
+  std::vector<std::uint32_t> starts_;
+  std::vector<std::uint32_t> lengths_;
+  std::vector<std::uint32_t> payloads_;
+  std::vector<std::uint64_t> errors_;
+  std::vector<numeric_value> values_;  // of numerics, indexed by their payload
+  std::size_t dead_values_ = 0;        // values of dropped numerics still in values_
+  std::size_t first_ = 0;
+  std::size_t gap_at_ = no_gap;  // the index of the first token behind the gap
+  std::size_t gap_length_ = 0;
+  std::uint32_t tail_shift_ = 0;
+};
@@ -1,63 +1,266 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
 
+#include "char_class.hxx"
+#include "function_ref.hxx"
 #include "source.hxx"
+#include "source_manager.hxx"
+#include "token_buffer.hxx"
 
-enum class token_type { unknown, bracket, semicolon, whitespace, oper, identifier, function_identifier, numeric, eof };
+class thread_pool;
 
+// a token as handed out by the tokenizer, the stored form is the token_buffer
 struct token {
   token_type type;
-  source_range pos;
   std::string_view text;  // NOT null terminated!
   bool error;
+  symbol_id symbol;  // identifiers are interned while lexing, no_symbol otherwise
+  std::uint64_t value;  // numerics: the magnitude of the literal, decoded while lexing (see tokenizer)
+  bool negative;        // numerics: the literal starts with '-'
 };
 
+// a change of the text: length bytes at offset are replaced by replacement
+struct text_edit {
+  std::uint32_t offset;
+  std::uint32_t length;
+  std::string_view replacement;
+};
+
+// tokens [first, first + removed) of the old stream were replaced by [first, first + inserted)
+struct token_edit {
+  std::size_t first;
+  std::size_t removed;
+  std::size_t inserted;
+};
+
+// The length of the operator token at the start of text: operator symbols, then identifier characters, then symbols
+// again, as long as extend(c) says that the text so far and c is an operator or the prefix of one. Maximal munch in
+// one pass, extend is called once per consumed character, and once more for the first one that doesn't fit.
+template <typename F>
+std::size_t scan_operator(std::string_view text, F&& extend) noexcept {
+  std::size_t n = 0;
+  for (const std::uint8_t classes : {cc_operator, cc_identifier, cc_operator}) {
+    for (; n < text.size() && has_class(text[n], classes); ++n) {
+      if (!extend(text[n])) {
+        return n;
+      }
+    }
+  }
+  return n;
+}
+
+// Numeric tokens carry their decoded magnitude and sign, the '-' at the start of the text. Literals below
+// -2^63 or above 2^64-1 are lexical errors. The value of an erroneous numeric is meaningless, it is 0.
 class tokenizer {
  public:
-  using lookup_t = std::function<bool(std::string_view)>;
+  // is the text an operator or the prefix of one? asked for every prefix of an operator token
+  using lookup_t = function_ref<bool(std::string_view)>;
+  using lookup_fn_t = std::function<bool(std::string_view)>;
 
+  // the length of the operator token at the start of the text, for compiled operator sets (see scan_operator)
+  using scan_t = function_ref<std::size_t(std::string_view)>;
+  struct operator_scanner {
+    scan_t scan;
+  };
+
+  // borrows the file's text, the manager has to outlive the tokenizer
+  tokenizer(source_manager const& sources, file_id file, diagnostic_reporter& reporter) noexcept;
+
+  // owns a copy of the text, for tests and small inputs
   tokenizer(std::string filename, std::string content, diagnostic_reporter& reporter);
 
-  token const& next_token(lookup_t is_operator_or_prefix) noexcept;
+  // Streaming: the text is read from fd (a file or a pipe, not closed by the tokenizer) in chunks, as tokens are
+  // requested. Only the text and tokens from the oldest live checkpointer (or the cursor) on are kept, so memory is
+  // bounded by the chunk size and the lookahead. Older token indices are invalid, and the text of a token is only
+  // valid until the next read. Edits are not supported.
+  tokenizer(std::string filename, int fd, diagnostic_reporter& reporter, std::size_t chunk_size = 64 * 1024);
+
+  tokenizer(tokenizer const&) = delete;
+  tokenizer& operator=(tokenizer const&) = delete;
+  ~tokenizer();
+
+  std::string_view filename() const noexcept { return filename_; }
+  std::string_view content() const noexcept { return content_; }
+
+  // offset of content() in the whole text, only streaming tokenizers drop the text before it
+  std::uint64_t content_offset() const noexcept { return text_base_; }
+
+  token next_token(lookup_t is_operator_or_prefix) noexcept;
+
+  template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, lookup_t> &&
+                                                    !std::is_same_v<std::decay_t<F>, lookup_fn_t> &&
+                                                    std::is_invocable_r_v<bool, F&, std::string_view>>>
+  token next_token(F&& is_operator_or_prefix) noexcept {
+    return next_token(lookup_t{is_operator_or_prefix});
+  }
+
+  // compatibility overload, prefer passing the callable directly
+  token next_token(lookup_fn_t const& is_operator_or_prefix) noexcept {
+    return next_token(lookup_t{is_operator_or_prefix});
+  }
+
+  token next_token(operator_scanner scanner) noexcept;
+
+  // uses the lookup or scanner bound last, by default nothing is an operator
+  token next_token() noexcept { return next_token(operator_scanner{bound_scan_}); }
+
+  // the referenced callable has to outlive the binding
+  void bind_operator_lookup(lookup_t is_operator_or_prefix) noexcept {
+    bound_lookup_ = is_operator_or_prefix;
+    bound_scan_ = scan_t::bind<&tokenizer::scan_bound_lookup>(*this);
+  }
+  void bind_operator_scanner(operator_scanner scanner) noexcept { bound_scan_ = scanner.scan; }
+
+  std::optional<token> skip_whitespace() noexcept;
 
-  const token* skip_whitespace() noexcept;
+  // Lexes the rest of the text with the bound lookup or scanner, as next_token calls would, until the end or an
+  // operator that can't make progress (the last token, with empty text). The text is split into up to `parts` parts
+  // at whitespace runs with a newline, where a token always starts; the parts are lexed on the pool and the calling
+  // thread, and their tokens are appended in order. Tokens and diagnostics are the same as lexing in one pass.
+  // The bound lookup or scanner is called concurrently. Streams and a cursor before the end are lexed in one pass.
+  void lex_parallel(thread_pool& pool, std::size_t parts);
 
+  // Pipelined lexing: a producer thread lexes ahead with the bound lookup or scanner, at most `lookahead` tokens,
+  // and next_token takes its tokens from a lock-free queue. The operators have to stay fixed while it runs, scanners
+  // passed to next_token are ignored. Checkpointers created while it runs only move the cursor back, the lexed tokens
+  // stay, also when they are rolled back after its end.
+  // It ends at the end of the text (or a stalled operator), after that tokens are lexed on the calling thread again.
+  // Not for streams.
+  void start_pipeline(std::size_t lookahead = 4096);
+
+  // ends the pipeline early, waits for the producer: the tokens next_token didn't take yet are dropped
+  void stop_pipeline() noexcept;
+
+  bool pipelined() const noexcept { return pipeline_ != nullptr; }
+
+  // Index of the token next_token hands out next. Tokens before the end of the stream are replayed as stored,
+  // new ones are only lexed at the end.
+  std::size_t cursor() const noexcept { return cursor_; }
+  void seek(std::size_t token) noexcept { cursor_ = std::min(token, tokens_.size()); }
+
+  // Re-lexes after an edit, with the bound operator lookup or scanner. new_content is the whole text with the edit
+  // applied, and has to outlive the tokenizer. Lexing starts at the first token touching the edit, and stops at the
+  // first boundary after it where the old stream continues unchanged. The tokens and lines after that stay where they
+  // are, behind the gaps of token_buffer and line_index: an edit costs the re-lexed tokens and the distance to the
+  // previous edit, not the size of the file.
+  token_edit apply_edit(text_edit const& edit, std::string_view new_content);
+
+  // the same, for tokenizers that own their text, the edit is applied to it: the text after the edit is moved when
+  // the length changes, a memmove of the rest of the file
+  token_edit apply_edit(text_edit const& edit);
+
+  token_buffer const& tokens() const noexcept { return tokens_; }
+
+  token token_at(std::size_t i) const noexcept {
+    const auto kind = tokens_.kind(i);
+    const bool numeric = kind == token_type::numeric;
+    return {kind, content_.substr(tokens_.start(i), tokens_.length(i)), tokens_.error(i),
+            numeric ? no_symbol : tokens_.symbol(i), numeric ? tokens_.value(i) : 0, tokens_.negative(i)};
+  }
+
+  // line / column of a byte offset in content() or token, the line table is built on first use
+  source_pos position(std::uint32_t offset) const;
+  source_range range(token const& t) const;
+  // of the bytes [from, to) of content()
+  source_range span(std::size_t from, std::size_t to) const;
+
+  // rolls back to the position of its creation, unless committed
+  // with keep_tokens only the cursor goes back, the tokens lexed since then are replayed by the next reads
+  // while it lives, a streaming tokenizer keeps its tokens
   class checkpointer {
    public:
-    checkpointer(tokenizer& t) noexcept;
+    checkpointer(tokenizer& t, bool keep_tokens = false) noexcept;
+    checkpointer(checkpointer const&) = delete;
+    checkpointer& operator=(checkpointer const&) = delete;
     ~checkpointer();
 
     void commit() noexcept;
 
    private:
+    friend class tokenizer;
+
     tokenizer& t_;
-    std::size_t index_;
-    source_pos position_;
+    std::uint64_t index_;  // in the whole text, the content can move under it
     std::size_t vec_size_;
+    std::size_t cursor_;
+    bool keep_tokens_;
+    checkpointer* older_;  // the live checkpointers of the tokenizer, a list
+    checkpointer* newer_ = nullptr;
 
-    static const constexpr std::size_t npos = std::string::npos;
+    static const constexpr std::uint64_t npos = ~std::uint64_t{0};
   };
 
  private:
-  std::string filename_;
-  std::string content_;
-  std::size_t index_;
-  source_pos position_;
-  std::vector<token> tokens_;
+  std::string owned_filename_;
+  std::string owned_content_;
+  std::string_view filename_;
+  std::string_view content_;  // NOT null terminated!
+  std::size_t index_;  // the lexing position, the end of the stored tokens
+  token_buffer tokens_;
+  std::size_t cursor_;
+  mutable std::optional<line_index> lines_;
   diagnostic_reporter& reporter_;
+  lookup_t bound_lookup_;
+  scan_t bound_scan_;
+  checkpointer* checkpoints_ = nullptr;  // the newest live one
+  std::uint64_t diagnosed_to_ = 0;       // the lexical errors of tokens starting before this were reported
+
+  struct pipeline;
+  std::unique_ptr<pipeline> pipeline_;
+
+  // streaming: owned_content_ is a window of the text from text_base_ on
+  int fd_ = -1;
+  std::size_t chunk_size_ = 0;
+  bool exhausted_ = true;
+  std::size_t safe_end_ = 0;  // tokens starting before this end in the window, and so does the lookahead after them
+  std::uint64_t text_base_ = 0;
+  std::uint64_t base_line_ = 0;        // newlines before text_base_
+  std::uint64_t base_line_start_ = 0;  // where the line of text_base_ starts in the whole text
+
+  // streaming: reads until a token can be lexed at index_ or the input ends
+  void need_input() noexcept {
+    if (index_ >= safe_end_ && !exhausted_) {
+      fill();
+    }
+  }
+  void fill() noexcept;
+  // streaming: drops the text and tokens no live checkpointer and the cursor can return to
+  void release();
+
+  // borrows a part of the text, for lex_parallel
+  tokenizer(std::string_view filename, std::string_view content, diagnostic_reporter& reporter, scan_t scan) noexcept;
+
+  std::size_t scan_bound_lookup(std::string_view text) const noexcept;
+
+  // pipelined: moves the next token of the producer into the buffer, false (and the pipeline is gone) at its end
+  bool fetch() noexcept;
+  // the producer thread, on its own tokenizer
+  void produce(pipeline& p) noexcept;
+
+  // lexes until eof or a stalled operator, returns false on the latter
+  bool lex_rest(scan_t scan) noexcept;
+
+  // lexes the token at index_ into the buffer
+  token lex_token(scan_t scan, token_buffer& into) noexcept;
 
-  token create_token(lookup_t is_operator_or_prefix) noexcept;
+  // lexes the token at index_ and moves past it, returns its type and error flag
+  std::pair<token_type, bool> create_token(scan_t scan) noexcept;
+  // reports the diagnostic of a lexed token [from, to), if it has one
+  void diagnose(token_type type, bool error, std::size_t from, std::size_t to);
   bool try_numeric() noexcept;
   bool try_whitespace() noexcept;
-  bool try_operator(lookup_t is_operator_or_prefix) noexcept;
+  bool try_operator(scan_t scan) noexcept;
   token_type try_identifier() noexcept;
 
-  template <typename... T>
-  bool check_continuation(T... fs) noexcept;
+  // is the character after the current token one of the allowed classes?
+  bool check_continuation(std::uint8_t allowed_classes) const noexcept;
 };
@@ -0,0 +1,229 @@
+
+#include "char_class.hxx"
+
+#include <cstring>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define METAMORF_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+#if defined(_WIN32) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define METAMORF_SWAR_DIGITS 1
+#endif
+
+namespace {
+
+template <std::uint8_t Classes>
+const char* scan_scalar(const char* begin, const char* end) noexcept {
+  while (begin != end && has_class(*begin, Classes)) {
+    ++begin;
+  }
+  return begin;
+}
+
+void line_starts_scalar(const char* begin, const char* end, std::vector<std::uint32_t>& starts) {
+  for (const char* it = begin; it != end; ++it) {
+    if (*it == '\n') {
+      starts.push_back(static_cast<std::uint32_t>(it - begin + 1));
+    }
+  }
+}
+
+const scan_kernels scalar_kernels = {"scalar", scan_scalar<cc_whitespace>, scan_scalar<cc_identifier>,
+                                     scan_scalar<cc_digit>, line_starts_scalar};
+
+#ifdef METAMORF_X86_KERNELS
+
+// Each vector kernel classifies a whole register, and stops at the first lane outside the class.
+// The remaining tail (shorter than a register) goes through the scalar loop.
+
+// lanes in [lo, hi], using a signed compare after biasing the range to start at -128
+inline __m128i in_range_sse2(__m128i v, char lo, char hi) noexcept {
+  const __m128i biased = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(-128 - lo)));
+  return _mm_cmplt_epi8(biased, _mm_set1_epi8(static_cast<char>(-128 + (hi - lo) + 1)));
+}
+
+inline __m128i whitespace_sse2(__m128i v) noexcept {
+  return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+}
+
+inline __m128i digits_sse2(__m128i v) noexcept { return in_range_sse2(v, '0', '9'); }
+
+inline __m128i identifier_sse2(__m128i v) noexcept {
+  // setting 0x20 folds upper case letters onto lower case ones
+  const __m128i letter = in_range_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+  return _mm_or_si128(_mm_or_si128(letter, digits_sse2(v)), _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+}
+
+template <__m128i (*Classify)(__m128i), std::uint8_t Classes>
+const char* scan_sse2(const char* begin, const char* end) noexcept {
+  while (end - begin >= 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    const auto outside = ~static_cast<unsigned>(_mm_movemask_epi8(Classify(v))) & 0xffffu;
+    if (outside != 0) {
+      return begin + __builtin_ctz(outside);
+    }
+    begin += 16;
+  }
+  return scan_scalar<Classes>(begin, end);
+}
+
+// one bit per lane that holds a newline, appended as line starts
+inline void push_newlines(unsigned mask, std::uint32_t base, std::vector<std::uint32_t>& starts) {
+  while (mask != 0) {
+    starts.push_back(base + static_cast<std::uint32_t>(__builtin_ctz(mask)) + 1);
+    mask &= mask - 1;
+  }
+}
+
+void line_starts_sse2(const char* begin, const char* end, std::vector<std::uint32_t>& starts) {
+  const char* it = begin;
+  for (; end - it >= 16; it += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+    push_newlines(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')))),
+                  static_cast<std::uint32_t>(it - begin), starts);
+  }
+  const auto tail = starts.size();
+  line_starts_scalar(it, end, starts);
+  for (auto i = tail; i < starts.size(); ++i) {
+    starts[i] += static_cast<std::uint32_t>(it - begin);
+  }
+}
+
+const scan_kernels sse2_kernels = {"sse2", scan_sse2<whitespace_sse2, cc_whitespace>,
+                                   scan_sse2<identifier_sse2, cc_identifier>, scan_sse2<digits_sse2, cc_digit>,
+                                   line_starts_sse2};
+
+#define METAMORF_AVX2 __attribute__((target("avx2")))
+
+METAMORF_AVX2 inline __m256i in_range_avx2(__m256i v, char lo, char hi) noexcept {
+  const __m256i biased = _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(-128 - lo)));
+  return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + (hi - lo) + 1)), biased);
+}
+
+METAMORF_AVX2 inline __m256i whitespace_avx2(__m256i v) noexcept {
+  return _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+}
+
+METAMORF_AVX2 inline __m256i digits_avx2(__m256i v) noexcept { return in_range_avx2(v, '0', '9'); }
+
+METAMORF_AVX2 inline __m256i identifier_avx2(__m256i v) noexcept {
+  const __m256i letter = in_range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+  return _mm256_or_si256(_mm256_or_si256(letter, digits_avx2(v)), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+}
+
+template <__m256i (*Classify)(__m256i), __m128i (*Classify128)(__m128i), std::uint8_t Classes>
+METAMORF_AVX2 const char* scan_avx2(const char* begin, const char* end) noexcept {
+  while (end - begin >= 32) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+    const auto outside = ~static_cast<unsigned>(_mm256_movemask_epi8(Classify(v)));
+    if (outside != 0) {
+      return begin + __builtin_ctz(outside);
+    }
+    begin += 32;
+  }
+  return scan_sse2<Classify128, Classes>(begin, end);
+}
+
+METAMORF_AVX2 void line_starts_avx2(const char* begin, const char* end, std::vector<std::uint32_t>& starts) {
+  const char* it = begin;
+  for (; end - it >= 32; it += 32) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it));
+    push_newlines(static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')))),
+                  static_cast<std::uint32_t>(it - begin), starts);
+  }
+  const auto tail = starts.size();
+  line_starts_sse2(it, end, starts);
+  for (auto i = tail; i < starts.size(); ++i) {
+    starts[i] += static_cast<std::uint32_t>(it - begin);
+  }
+}
+
+const scan_kernels avx2_kernels = {"avx2", scan_avx2<whitespace_avx2, whitespace_sse2, cc_whitespace>,
+                                   scan_avx2<identifier_avx2, identifier_sse2, cc_identifier>,
+                                   scan_avx2<digits_avx2, digits_sse2, cc_digit>, line_starts_avx2};
+
+bool cpu_has_avx2() noexcept {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+#ifdef METAMORF_SWAR_DIGITS
+
+// the value of 8 digits loaded as one word: adjacent digits are combined into pairs, then quads, then both halves
+inline std::uint64_t eight_digits(const char* p) noexcept {
+  std::uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  v -= 0x3030303030303030;
+  v = v * 10 + (v >> 8);
+  v = ((v & 0x000000FF000000FF) * (100 + (1000000ull << 32)) +
+       ((v >> 16) & 0x000000FF000000FF) * (1 + (10000ull << 32))) >>
+      32;
+  return v;
+}
+
+#endif
+
+scan_kernels const& select_scan_kernels() noexcept {
+#ifdef METAMORF_X86_KERNELS
+  return cpu_has_avx2() ? avx2_kernels : sse2_kernels;
+#else
+  return scalar_kernels;
+#endif
+}
+
+}  // namespace
+
+scan_kernels const& active_scan_kernels() noexcept {
+  static scan_kernels const& kernels = select_scan_kernels();
+  return kernels;
+}
+
+std::vector<scan_kernels const*> available_scan_kernels() {
+  std::vector<scan_kernels const*> result{&scalar_kernels};
+#ifdef METAMORF_X86_KERNELS
+  result.push_back(&sse2_kernels);
+  if (cpu_has_avx2()) {
+    result.push_back(&avx2_kernels);
+  }
+#endif
+  return result;
+}
+
+bool decode_digits(const char* begin, const char* end, std::uint64_t& value) noexcept {
+  while (begin != end && *begin == '0') {
+    ++begin;
+  }
+  // up to 19 digits always fit, only the 20th needs a check
+  const auto digits = end - begin;
+  if (digits > 20) {
+    return false;
+  }
+  const char* const unchecked_end = digits == 20 ? end - 1 : end;
+
+  std::uint64_t v = 0;
+#ifdef METAMORF_SWAR_DIGITS
+  for (; unchecked_end - begin >= 8; begin += 8) {
+    v = v * 100000000 + eight_digits(begin);
+  }
+#endif
+  for (; begin != unchecked_end; ++begin) {
+    v = v * 10 + static_cast<std::uint64_t>(*begin - '0');
+  }
+  if (begin != end) {
+    const auto last = static_cast<std::uint64_t>(*begin - '0');
+    if (v > (std::numeric_limits<std::uint64_t>::max() - last) / 10) {
+      return false;
+    }
+    v = v * 10 + last;
+  }
+  value = v;
+  return true;
+}
@@ -0,0 +1,362 @@
+
+#include "driver.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <optional>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+#include "parse_cache.hxx"
+#include "parser.hxx"
+#include "source_manager.hxx"
+#include "thread_pool.hxx"
+#include "tokenizer.hxx"
+
+class read_error_t : public diagnostic_message {
+  virtual diagnostic_level level() const { return diagnostic_level::error; }
+  virtual std::string message() const { return "Driver error: can't read the file."; }
+  virtual int diagnostic_code() const { return 100; }
+};
+
+class parse_error_t : public diagnostic_message {
+  virtual diagnostic_level level() const { return diagnostic_level::error; }
+  virtual std::string message() const { return "Parser error: invalid block."; }
+  virtual int diagnostic_code() const { return 101; }
+};
+
+class stalled_lexer_t : public diagnostic_message {
+  virtual diagnostic_level level() const { return diagnostic_level::error; }
+  virtual std::string message() const { return "Tokenizer error: can't continue after an invalid operator."; }
+  virtual int diagnostic_code() const { return 102; }
+};
+
+class file_too_large_t : public diagnostic_message {
+  virtual diagnostic_level level() const { return diagnostic_level::error; }
+  virtual std::string message() const { return "Driver error: the file is larger than 4 GiB."; }
+  virtual int diagnostic_code() const { return 103; }
+};
+
+read_error_t read_error;
+parse_error_t parse_error;
+stalled_lexer_t stalled_lexer;
+file_too_large_t file_too_large;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+double seconds_since(clock_type::time_point start) {
+  return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+// files from this size on are split, so one large file doesn't leave the other workers idle
+constexpr std::size_t parallel_lex_part_bytes = 1 << 20;
+
+// lexes the whole file, stops early at tokens that can't make progress (invalid operators)
+std::size_t lex_file(tokenizer& t, parser_context& pc, file_result& result, thread_pool& pool) {
+  t.bind_operator_scanner({tokenizer::scan_t::bind<&parser_context::operator_scan>(pc)});
+  t.lex_parallel(pool, std::min(pool.size(), t.content().size() / parallel_lex_part_bytes));
+  const auto last = t.token_at(t.tokens().size() - 1);
+  if (last.type != token_type::eof && last.text.empty()) {
+    result.diagnostics.report({stalled_lexer, t.range(last), ""});
+  }
+  return t.tokens().size();
+}
+
+// the file is a sequence of top level blocks, from the cursor of the tokenizer
+// without roots, the tree of a block is dropped once it parsed
+bool parse_file(tokenizer& t, file_result& result, ast_arena& arena, std::vector<ast_index>* roots) {
+  for (;;) {
+    t.skip_whitespace();
+    const auto tok = t.next_token();
+    if (tok.type == token_type::eof) {
+      return true;
+    }
+    if (tok.type != token_type::bracket || tok.text != "{") {
+      result.diagnostics.report({parse_error, t.range(tok), ""});
+      return false;
+    }
+    const auto block = parser_block::parse(t, arena);
+    if (!block) {
+      // the tokens of the block may be rolled back, its text is still there
+      const auto error = block.error();
+      result.diagnostics.report({parse_error, t.span(error.start, error.start + error.length), ""});
+      return false;
+    }
+    if (roots != nullptr) {
+      roots->push_back(*block);
+    } else {
+      arena.clear();
+    }
+  }
+}
+
+void process_file(source_manager& sources, parse_cache const* cache, bool pipeline, file_result& result,
+                  thread_pool& pool, trace_recorder* trace) {
+  trace_binding binding(trace, result.path);
+  auto start = clock_type::now();
+  file_id file = 0;
+  {
+    phase_timer timer("read");
+    try {
+      file = sources.load_file(result.path);
+    } catch (std::system_error const& e) {
+      if (e.code() == std::errc::file_too_large) {
+        result.diagnostics.report({file_too_large, {{0, 0}, {0, 0}}, ""});
+      } else {
+        result.diagnostics.report({read_error, {{0, 0}, {0, 0}}, ""});
+      }
+      return;
+    } catch (std::exception const&) {
+      result.diagnostics.report({read_error, {{0, 0}, {0, 0}}, ""});
+      return;
+    }
+  }
+  result.bytes = sources.content(file).size();
+  result.read = {seconds_since(start), result.bytes, 0};
+
+  parser_context root;
+  std::uint64_t key = 0;
+  if (cache != nullptr) {
+    phase_timer timer("cache");
+    key = parse_cache::key(sources.content(file), root);
+    if (const auto unit = cache->find(key, result.bytes)) {
+      result.tokens = unit->token_count();
+      result.parsed = true;
+      result.cached = true;
+      return;
+    }
+  }
+
+  tokenizer t(sources, file, result.diagnostics);
+  ast_arena arena;
+  std::vector<ast_index> roots;
+
+  if (pipeline) {
+    // the tokens are lexed on a producer thread while the parser consumes them, there is no lex phase of its own
+    start = clock_type::now();
+    {
+      phase_timer timer("parse");
+      t.bind_operator_scanner({tokenizer::scan_t::bind<&parser_context::operator_scan>(root)});
+      t.start_pipeline();
+      result.parsed = parse_file(t, result, arena, &roots);
+      t.stop_pipeline();
+    }
+    result.tokens = t.tokens().size();
+    result.parse = {seconds_since(start), result.bytes, result.tokens};
+  } else {
+    start = clock_type::now();
+    {
+      phase_timer timer("lex");
+      result.tokens = lex_file(t, root, result, pool);
+    }
+    result.lex = {seconds_since(start), result.bytes, result.tokens};
+
+    // the tokens of the lex phase are replayed
+    start = clock_type::now();
+    {
+      phase_timer timer("parse");
+      t.seek(0);
+      result.parsed = parse_file(t, result, arena, &roots);
+    }
+    result.parse = {seconds_since(start), result.bytes, result.tokens};
+  }
+
+  // only clean files, so a hit has no diagnostics to replay
+  if (cache != nullptr && result.parsed && result.diagnostics.messages().empty() &&
+      result.diagnostics.suppressed() == 0) {
+    phase_timer timer("cache");
+    cache->store(key, result.bytes, t.tokens(), arena, roots);
+  }
+}
+
+// stdin is lexed and parsed in one pass, only the text, tokens and tree of one top level block are kept in memory
+void process_stdin(file_result& result, trace_recorder* trace) {
+  trace_binding binding(trace, result.path);
+  phase_timer timer("parse");
+  const auto start = clock_type::now();
+  parser_context root;
+  tokenizer t(result.path, 0, result.diagnostics);
+  t.bind_operator_scanner({tokenizer::scan_t::bind<&parser_context::operator_scan>(root)});
+  ast_arena arena;
+  result.parsed = parse_file(t, result, arena, nullptr);
+  result.bytes = static_cast<std::size_t>(t.content_offset() + t.content().size());
+  result.tokens = t.tokens().size();
+  result.parse = {seconds_since(start), result.bytes, result.tokens};
+}
+
+void print_phase(char const* name, phase_stats const& stats) {
+  const double mb = static_cast<double>(stats.bytes) / 1e6;
+  std::fprintf(stderr, "  %-6s %9.3f s in workers  %10.1f MB/s per worker", name, stats.seconds,
+               stats.seconds > 0 ? mb / stats.seconds : 0);
+  if (stats.tokens != 0 && stats.seconds > 0) {
+    std::fprintf(stderr, "  %8.2f Mtok/s per worker", static_cast<double>(stats.tokens) / 1e6 / stats.seconds);
+  }
+  std::fprintf(stderr, "\n");
+}
+
+void add(phase_stats& total, phase_stats const& s) {
+  total.seconds += s.seconds;
+  total.bytes += s.bytes;
+  total.tokens += s.tokens;
+}
+
+}  // namespace
+
+bool driver_result::has_errors() const noexcept {
+  return std::any_of(files.begin(), files.end(), [](auto const& f) { return f.diagnostics.error_count() != 0; });
+}
+
+driver_result run_driver(driver_options const& options) {
+  driver_result result;
+  result.files.resize(options.files.size());
+  for (std::size_t i = 0; i < options.files.size(); ++i) {
+    result.files[i].path = options.files[i];
+  }
+
+  if (trace_recorder::enabled) {
+    result.trace = std::make_unique<trace_recorder>();
+  }
+  auto* trace = result.trace.get();
+
+  std::optional<parse_cache> cache;
+  if (!options.cache_dir.empty()) {
+    cache.emplace(options.cache_dir);
+  }
+  auto const* cache_ptr = cache ? &*cache : nullptr;
+
+  const auto start = clock_type::now();
+  source_manager sources;
+  {
+    thread_pool pool(options.jobs);
+    result.jobs = pool.size();
+    // every task owns one result slot, so the output order doesn't depend on scheduling
+    for (auto& f : result.files) {
+      if (f.path == "-") {
+        pool.submit([&f, trace] { process_stdin(f, trace); });
+      } else {
+        pool.submit([&sources, cache_ptr, pipeline = options.pipeline, &f, &pool, trace] {
+          process_file(sources, cache_ptr, pipeline, f, pool, trace);
+        });
+      }
+    }
+    pool.wait();
+  }
+  result.wall_seconds = seconds_since(start);
+  return result;
+}
+
+void report_driver_result(driver_result const& result) {
+  phase_stats read, lex, parse;
+  std::size_t parsed = 0;
+  std::size_t cached = 0;
+  std::size_t bytes = 0;
+  for (auto const& f : result.files) {
+    f.diagnostics.render(f.path);
+    add(read, f.read);
+    add(lex, f.lex);
+    add(parse, f.parse);
+    parsed += f.parsed ? 1 : 0;
+    cached += f.cached ? 1 : 0;
+    bytes += f.bytes;
+  }
+
+  std::fprintf(stderr, "%zu files (%zu parsed, %zu cached), %.1f MB, %zu jobs, %.3f s wall, %.1f MB/s\n",
+               result.files.size(), parsed, cached, static_cast<double>(bytes) / 1e6, result.jobs, result.wall_seconds,
+               result.wall_seconds > 0 ? static_cast<double>(bytes) / 1e6 / result.wall_seconds : 0);
+  print_phase("read", read);
+  print_phase("lex", lex);
+  print_phase("parse", parse);
+  if (result.trace) {
+    result.trace->log_summary();
+  }
+}
+
+bool write_driver_trace(driver_result const& result, std::string const& path) {
+  if (!result.trace) {
+    return false;
+  }
+  std::ofstream out(path);
+  result.trace->write_chrome_trace(out);
+  return static_cast<bool>(out.flush());
+}
+
+std::size_t max_driver_jobs() noexcept {
+  return std::max<std::size_t>(64, 4 * std::size_t{std::thread::hardware_concurrency()});
+}
+
+bool parse_driver_options(int argc, char const* const* argv, driver_options& options, std::string& error) {
+  const auto parse_jobs = [&](std::string_view value) {
+    const auto limit = max_driver_jobs();
+    std::size_t jobs = 0;
+    for (char c : value) {
+      if (c < '0' || c > '9') {
+        error = "invalid job count: " + std::string(value);
+        return false;
+      }
+      jobs = jobs * 10 + static_cast<std::size_t>(c - '0');
+      if (jobs > limit) {
+        // checked per digit, so long numbers can't wrap around
+        error = "job count over " + std::to_string(limit) + ": " + std::string(value);
+        return false;
+      }
+    }
+    if (value.empty() || jobs == 0) {
+      error = "invalid job count: " + std::string(value);
+      return false;
+    }
+    options.jobs = jobs;
+    return true;
+  };
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg == "-j") {
+      if (i + 1 == argc) {
+        error = "-j needs a job count";
+        return false;
+      }
+      if (!parse_jobs(argv[++i])) {
+        return false;
+      }
+    } else if (arg == "--trace") {
+      if (!trace_recorder::enabled) {
+        error = "--trace needs a build with METAMORF_INSTRUMENT";
+        return false;
+      }
+      if (i + 1 == argc) {
+        error = "--trace needs a file name";
+        return false;
+      }
+      options.trace_path = argv[++i];
+    } else if (arg == "--cache") {
+      if (i + 1 == argc) {
+        error = "--cache needs a directory";
+        return false;
+      }
+      options.cache_dir = argv[++i];
+    } else if (arg == "--pipeline") {
+      options.pipeline = true;
+    } else if (arg.substr(0, 2) == "-j") {
+      if (!parse_jobs(arg.substr(2))) {
+        return false;
+      }
+    } else if (arg.size() > 1 && arg[0] == '-') {
+      error = "unknown option: " + std::string(arg);
+      return false;
+    } else {
+      options.files.emplace_back(arg);
+    }
+  }
+
+  if (options.files.empty()) {
+    error = "no input files";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,81 @@
+
+#include "hash.hxx"
+
+namespace {
+
+constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ull;
+constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr std::uint64_t prime3 = 0x165667B19E3779F9ull;
+constexpr std::uint64_t prime4 = 0x85EBCA77C2B2AE63ull;
+constexpr std::uint64_t prime5 = 0x27D4EB2F165667C5ull;
+
+inline std::uint64_t rotl(std::uint64_t x, int r) noexcept { return (x << r) | (x >> (64 - r)); }
+
+// little endian, the same value on every platform
+inline std::uint64_t read64(const unsigned char* p) noexcept {
+  std::uint64_t v = 0;
+  for (int i = 7; i >= 0; --i) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+inline std::uint64_t read32(const unsigned char* p) noexcept {
+  return std::uint64_t{p[0]} | std::uint64_t{p[1]} << 8 | std::uint64_t{p[2]} << 16 | std::uint64_t{p[3]} << 24;
+}
+
+inline std::uint64_t mix_round(std::uint64_t acc, std::uint64_t input) noexcept {
+  return rotl(acc + input * prime2, 31) * prime1;
+}
+
+inline std::uint64_t merge_round(std::uint64_t acc, std::uint64_t val) noexcept {
+  return (acc ^ mix_round(0, val)) * prime1 + prime4;
+}
+
+}  // namespace
+
+std::uint64_t hash_bytes(std::string_view data, std::uint64_t seed) noexcept {
+  auto p = reinterpret_cast<const unsigned char*>(data.data());
+  const auto end = p + data.size();
+  std::uint64_t h;
+
+  // four independent lanes over 32 byte stripes
+  if (data.size() >= 32) {
+    std::uint64_t v1 = seed + prime1 + prime2;
+    std::uint64_t v2 = seed + prime2;
+    std::uint64_t v3 = seed;
+    std::uint64_t v4 = seed - prime1;
+    for (; end - p >= 32; p += 32) {
+      v1 = mix_round(v1, read64(p));
+      v2 = mix_round(v2, read64(p + 8));
+      v3 = mix_round(v3, read64(p + 16));
+      v4 = mix_round(v4, read64(p + 24));
+    }
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge_round(h, v1);
+    h = merge_round(h, v2);
+    h = merge_round(h, v3);
+    h = merge_round(h, v4);
+  } else {
+    h = seed + prime5;
+  }
+  h += data.size();
+
+  for (; end - p >= 8; p += 8) {
+    h = rotl(h ^ mix_round(0, read64(p)), 27) * prime1 + prime4;
+  }
+  if (end - p >= 4) {
+    h = rotl(h ^ (read32(p) * prime1), 23) * prime2 + prime3;
+    p += 4;
+  }
+  for (; p != end; ++p) {
+    h = rotl(h ^ (*p * prime5), 11) * prime1;
+  }
+
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  h *= prime3;
+  h ^= h >> 32;
+  return h;
+}
@@ -0,0 +1,108 @@
+
+#include "incremental.hxx"
+
+#include <deque>
+#include <vector>
+
+#include "parser.hxx"
+
+namespace {
+
+// Moves the token indices of a subtree that are behind the changed tokens. Subtrees that end before the change are
+// skipped, so this costs the nodes from the change to the end of the subtree.
+void shift_tokens(ast_arena& arena, ast_index root, token_edit const& edit) {
+  if (edit.inserted == edit.removed) {
+    return;
+  }
+  const auto old_end = edit.first + edit.removed;
+  const auto shift = [&edit, old_end](std::uint32_t& token) {
+    if (token >= old_end) {
+      token = static_cast<std::uint32_t>(token + edit.inserted - edit.removed);
+    }
+  };
+  std::vector<ast_index> stack{root};
+  while (!stack.empty()) {
+    const auto i = stack.back();
+    stack.pop_back();
+    auto& n = arena[i];
+    if (n.last_token < edit.first) {
+      continue;
+    }
+    const auto children = arena.children(i);
+    stack.insert(stack.end(), children.begin(), children.end());
+    shift(n.first_token);
+    shift(n.last_token);
+    if (n.kind == ast_kind::decl_stmt) {
+      shift(n.lhs);
+      shift(n.rhs);
+    }
+  }
+}
+
+// is the changed range strictly inside the brackets of the block?
+bool encloses(ast_node const& block, token_edit const& edit) {
+  return block.kind == ast_kind::block && block.first_token < edit.first &&
+         block.last_token >= edit.first + edit.removed;
+}
+
+}  // namespace
+
+ast_index reparse_after_edit(tokenizer& t, ast_arena& arena, ast_index root, token_edit const& edit) {
+  if (edit.removed == 0 && edit.inserted == 0) {
+    return root;
+  }
+  if (!encloses(arena[root], edit)) {
+    return no_node;
+  }
+
+  // blocks from the root down to the innermost one around the change
+  std::vector<ast_index> path{root};
+  for (bool found = true; found;) {
+    found = false;
+    for (auto child : arena.children(path.back())) {
+      if (encloses(arena[child], edit)) {
+        path.push_back(child);
+        found = true;
+        break;
+      }
+    }
+  }
+
+  shift_tokens(arena, root, edit);
+
+  // scopes of the ancestors, with the variables declared before the next block on the path
+  std::deque<parser_context> scopes(1);
+  for (std::size_t i = 0; i + 1 < path.size(); ++i) {
+    if (i != 0) {
+      scopes.emplace_back(scopes.back());
+    }
+    for (auto child : arena.children(path[i])) {
+      if (child == path[i + 1]) {
+        break;
+      }
+      if (arena[child].kind == ast_kind::decl_stmt) {
+        scopes.back().declare_variable(t.tokens().symbol(arena[child].lhs));
+      }
+    }
+  }
+
+  // blocks tried at a deeper level are not parsed again by the enclosing ones
+  parse_memo memo;
+  for (auto depth = path.size(); depth-- != 0;) {
+    const auto old = path[depth];
+    const auto expected_end = arena[old].last_token;
+    t.seek(arena[old].first_token + std::size_t{1});
+    if (depth == 0) {
+      // the root has to keep its span, the top level is a sequence of blocks
+      const auto block = parser_block::parse(t, arena, &memo);
+      return block && arena[*block].last_token == expected_end ? *block : no_node;
+    }
+    const auto block = parser_block::parse(scopes[depth - 1], t, arena, &memo);
+    if (block && arena[*block].last_token == expected_end) {
+      arena.replace_child(path[depth - 1], old, *block);
+      return root;
+    }
+    // doesn't parse on its own, or the brackets changed and the enclosing block ends somewhere else too
+  }
+  return no_node;
+}
@@ -0,0 +1,192 @@
+
+#include "instrument.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <ostream>
+
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/logger.h>
+#include <spdlog/sinks/stdout_sinks.h>
+
+namespace {
+
+constexpr std::array<char const*, static_cast<std::size_t>(counter::count)> counter_names{
+    "rollbacks", "discarded_tokens", "operator_lookups", "diagnostics"};
+
+constexpr std::array<char const*, static_cast<std::size_t>(token_type::eof) + 1> token_names{
+    "unknown", "bracket", "semicolon", "whitespace", "operator", "identifier", "function_identifier", "numeric", "eof"};
+
+std::uint64_t since(std::chrono::steady_clock::time_point origin) {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count());
+}
+
+// small and stable per thread, unlike std::thread::id
+std::uint32_t thread_index() {
+  static std::atomic<std::uint32_t> next{1};
+  static thread_local const std::uint32_t index = next.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+void write_json_string(std::ostream& out, std::string_view s) {
+  out << '"';
+  for (const char c : s) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out << escaped;
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+// trace_event timestamps are microseconds
+void write_us(std::ostream& out, std::uint64_t ns) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.3f", static_cast<double>(ns) / 1e3);
+  out << buffer;
+}
+
+spdlog::logger& summary_logger() {
+  static const auto log = [] {
+    auto l = std::make_shared<spdlog::logger>("instrument", std::make_shared<spdlog::sinks::stderr_sink_mt>());
+    l->set_pattern("%v");
+    return l;
+  }();
+  return *log;
+}
+
+double ms(std::uint64_t ns) { return static_cast<double>(ns) / 1e6; }
+
+}  // namespace
+
+counter_set& counter_set::operator+=(counter_set const& other) noexcept {
+  for (std::size_t i = 0; i < counters.size(); ++i) {
+    counters[i] += other.counters[i];
+  }
+  for (std::size_t i = 0; i < tokens.size(); ++i) {
+    tokens[i] += other.tokens[i];
+  }
+  return *this;
+}
+
+trace_recorder::trace_recorder() noexcept : origin_(std::chrono::steady_clock::now()) {}
+
+trace_track* trace_recorder::open_track(std::string name) {
+  auto track = std::make_unique<trace_track>();
+  track->name = std::move(name);
+  track->thread = thread_index();
+  track->origin = origin_;
+  track->start_ns = since(origin_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  tracks_.push_back(std::move(track));
+  return tracks_.back().get();
+}
+
+std::vector<trace_track> trace_recorder::tracks() const {
+  std::vector<trace_track> result;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto const& t : tracks_) {
+      result.push_back(*t);
+    }
+  }
+  std::stable_sort(result.begin(), result.end(), [](auto const& a, auto const& b) { return a.start_ns < b.start_ns; });
+  return result;
+}
+
+counter_set trace_recorder::totals() const {
+  counter_set result;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto const& t : tracks_) {
+    result += t->counts;
+  }
+  return result;
+}
+
+void trace_recorder::write_chrome_trace(std::ostream& out) const {
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  const auto begin_event = [&](std::string_view name, char const* category, std::uint32_t thread,
+                               std::uint64_t start_ns, std::uint64_t duration_ns) {
+    out << (first ? "\n" : ",\n") << "{\"name\":";
+    first = false;
+    write_json_string(out, name);
+    out << ",\"cat\":\"" << category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread << ",\"ts\":";
+    write_us(out, start_ns);
+    out << ",\"dur\":";
+    write_us(out, duration_ns);
+  };
+
+  for (auto const& t : tracks()) {
+    begin_event(t.name, "track", t.thread, t.start_ns, t.duration_ns);
+    out << ",\"args\":{";
+    for (std::size_t i = 0; i < counter_names.size(); ++i) {
+      out << (i == 0 ? "" : ",") << '"' << counter_names[i] << "\":" << t.counts.counters[i];
+    }
+    for (std::size_t i = 0; i < token_names.size(); ++i) {
+      out << ",\"tokens." << token_names[i] << "\":" << t.counts.tokens[i];
+    }
+    out << "}}";
+
+    for (auto const& e : t.events) {
+      begin_event(e.name, "phase", t.thread, e.start_ns, e.duration_ns);
+      out << ",\"args\":{\"track\":";
+      write_json_string(out, t.name);
+      out << "}}";
+    }
+  }
+  out << "\n]}\n";
+}
+
+void trace_recorder::log_summary(std::size_t slowest) const { log_summary(summary_logger(), slowest); }
+
+void trace_recorder::log_summary(spdlog::logger& log, std::size_t slowest) const {
+  auto tracks = this->tracks();
+  counter_set totals;
+  for (auto const& t : tracks) {
+    totals += t.counts;
+  }
+
+  log.info("instrumentation: {} tracks", tracks.size());
+  std::string line = "  tokens:";
+  for (std::size_t i = 0; i < token_names.size(); ++i) {
+    line += " " + std::string(token_names[i]) + " " + std::to_string(totals.tokens[i]);
+  }
+  log.info("{}", line);
+  line = " ";
+  for (std::size_t i = 0; i < counter_names.size(); ++i) {
+    line += " " + std::string(counter_names[i]) + " " + std::to_string(totals.counters[i]);
+  }
+  log.info("{}", line);
+
+  std::sort(tracks.begin(), tracks.end(), [](auto const& a, auto const& b) { return a.duration_ns > b.duration_ns; });
+  tracks.resize(std::min(tracks.size(), slowest));
+  for (auto const& t : tracks) {
+    line.clear();
+    for (auto const& e : t.events) {
+      line += fmt::format("{}{} {:.3f} ms", line.empty() ? "" : ", ", e.name, ms(e.duration_ns));
+    }
+    log.info("  {:.3f} ms {} ({}), {} rollbacks", ms(t.duration_ns), t.name, line, t.counts[counter::rollbacks]);
+  }
+}
+
+trace_binding::trace_binding(trace_recorder* recorder, std::string name) : previous_(current_track()) {
+  if (recorder != nullptr) {
+    track_ = recorder->open_track(std::move(name));
+    current_track() = track_;
+  }
+}
+
+trace_binding::~trace_binding() {
+  if (track_ != nullptr) {
+    track_->duration_ns = since(track_->origin) - track_->start_ns;
+    current_track() = previous_;
+  }
+}
@@ -1,4 +1,22 @@
 
-int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
-  return 0; //
+#include <cstdio>
+#include <string>
+
+#include "driver.hxx"
+
+int main(int argc, char *argv[]) {
+  driver_options options;
+  std::string error;
+  if (!parse_driver_options(argc, argv, options, error)) {
+    std::fprintf(stderr, "%s\nusage: %s [-j jobs] [--trace file] [--cache dir] [--pipeline] files...\n", error.c_str(),
+                 argv[0]);
+    return 2;
+  }
+
+  const auto result = run_driver(options);
+  report_driver_result(result);
+  if (!options.trace_path.empty() && !write_driver_trace(result, options.trace_path)) {
+    std::fprintf(stderr, "can't write the trace: %s\n", options.trace_path.c_str());
+  }
+  return result.has_errors() ? 1 : 0;
 }
@@ -0,0 +1,35 @@
+
+#include "operator_trie.hxx"
+
+#include <algorithm>
+
+void operator_trie::insert(std::string_view op) {
+  if (next_.empty()) {
+    next_.assign(2 * width_, dead);
+  }
+  for (char c : op) {
+    auto& column = column_[static_cast<unsigned char>(c)];
+    if (column != 0) {
+      continue;
+    }
+    // a new column at the end of every row
+    const auto states = next_.size() / width_;
+    std::vector<state> wider(states * (width_ + 1), dead);
+    for (std::size_t s = 0; s < states; ++s) {
+      std::copy(next_.begin() + s * width_, next_.begin() + (s + 1) * width_, wider.begin() + s * (width_ + 1));
+    }
+    next_.swap(wider);
+    column = static_cast<std::uint16_t>(width_++);
+  }
+
+  state s = root;
+  for (char c : op) {
+    const auto at = s * width_ + column_[static_cast<unsigned char>(c)];
+    if (next_[at] == dead) {
+      next_[at] = static_cast<state>(next_.size() / width_);
+      next_.resize(next_.size() + width_, dead);
+    }
+    s = next_[at];
+  }
+  ++count_;
+}
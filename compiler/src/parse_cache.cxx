@@ -0,0 +1,362 @@
+
+#include "parse_cache.hxx"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define METAMORF_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "hash.hxx"
+#include "parser.hxx"
+
+namespace {
+
+// The file is the header, then the arrays at 8 byte aligned offsets, in native byte order.
+struct cache_header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint64_t key;
+  std::uint64_t content_size;
+  std::uint64_t token_count;
+  std::uint64_t node_count;
+  std::uint64_t child_count;
+  std::uint64_t root_count;
+  std::uint64_t value_count;
+  std::uint64_t checksum;  // of the header before it and everything after the header
+};
+
+constexpr char cache_magic[8] = {'m', 'e', 't', 'a', 'm', 'o', 'r', 'f'};
+constexpr std::uint32_t native_byte_order = 0x01020304;
+
+static_assert(sizeof(cache_header) == 80);
+static_assert(std::is_trivially_copyable_v<ast_node> && sizeof(ast_node) == 20 && alignof(ast_node) == 4,
+              "the cache format stores ast_node as is, bump format_version after changing it");
+
+struct cache_layout {
+  std::size_t errors;
+  std::size_t negatives;
+  std::size_t starts;
+  std::size_t lengths;
+  std::size_t value_indices;
+  std::size_t values;
+  std::size_t nodes;
+  std::size_t children;
+  std::size_t roots;
+  std::size_t kinds;
+  std::size_t size;
+};
+
+cache_layout layout_of(cache_header const& h) {
+  const auto align = [](std::size_t n) { return (n + 7) & ~std::size_t{7}; };
+  cache_layout l{};
+  std::size_t at = sizeof(cache_header);
+  l.errors = at;
+  at += (h.token_count + 63) / 64 * sizeof(std::uint64_t);
+  l.negatives = at;
+  at += (h.token_count + 63) / 64 * sizeof(std::uint64_t);
+  l.starts = at;
+  at = align(at + h.token_count * sizeof(std::uint32_t));
+  l.lengths = at;
+  at = align(at + h.token_count * sizeof(std::uint32_t));
+  l.value_indices = at;
+  at = align(at + h.token_count * sizeof(std::uint32_t));
+  l.values = at;
+  at += h.value_count * sizeof(std::uint64_t);
+  l.nodes = at;
+  at = align(at + h.node_count * sizeof(ast_node));
+  l.children = at;
+  at = align(at + h.child_count * sizeof(ast_index));
+  l.roots = at;
+  at = align(at + h.root_count * sizeof(ast_index));
+  l.kinds = at;
+  l.size = at + h.token_count * sizeof(token_type);
+  return l;
+}
+
+std::uint64_t checksum_of(char const* entry, std::size_t size) noexcept {
+  const auto head = hash_bytes({entry, offsetof(cache_header, checksum)});
+  return hash_bytes({entry + sizeof(cache_header), size - sizeof(cache_header)}, head);
+}
+
+template <typename T>
+void put_array(std::string& out, std::size_t at, std::vector<T> const& v) {
+  if (!v.empty()) {
+    std::memcpy(out.data() + at, v.data(), v.size() * sizeof(T));
+  }
+}
+
+// a temporary name no other writer uses, the entry appears by a rename
+std::string temporary_path(std::string const& path) {
+  static std::atomic<std::uint64_t> counter{0};
+  const auto tag = hash_combine(
+      hash_combine(std::hash<std::thread::id>{}(std::this_thread::get_id()), counter.fetch_add(1)),
+      static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+  return path + ".tmp" + std::to_string(tag);
+}
+
+}  // namespace
+
+cached_unit::cached_unit(cached_unit&& other) noexcept
+    : mapping_(other.mapping_)
+    , mapping_size_(other.mapping_size_)
+    , token_count_(other.token_count_)
+    , node_count_(other.node_count_)
+    , root_count_(other.root_count_)
+    , child_count_(other.child_count_)
+    , value_count_(other.value_count_)
+    , kinds_(other.kinds_)
+    , starts_(other.starts_)
+    , lengths_(other.lengths_)
+    , value_indices_(other.value_indices_)
+    , values_(other.values_)
+    , errors_(other.errors_)
+    , negatives_(other.negatives_)
+    , nodes_(other.nodes_)
+    , children_(other.children_)
+    , roots_(other.roots_) {
+  other.mapping_ = nullptr;
+}
+
+cached_unit::~cached_unit() {
+  if (mapping_ == nullptr) {
+    return;
+  }
+#ifdef METAMORF_MMAP
+  munmap(mapping_, mapping_size_);
+#else
+  delete[] static_cast<std::uint64_t*>(mapping_);
+#endif
+}
+
+ast_arena::child_range cached_unit::children(ast_index parent) const noexcept {
+  auto const& n = nodes_[parent];
+  if (n.kind != ast_kind::block) {
+    return {nullptr, nullptr};
+  }
+  return {children_ + n.lhs, children_ + n.lhs + n.rhs};
+}
+
+bool cached_unit::consistent(std::uint64_t content_size) const {
+  for (std::size_t i = 0; i < token_count_; ++i) {
+    if (kinds_[i] > token_type::eof || std::uint64_t{starts_[i]} + lengths_[i] > content_size ||
+        (kinds_[i] == token_type::numeric && value_indices_[i] >= value_count_)) {
+      return false;
+    }
+  }
+  for (std::size_t i = 0; i < node_count_; ++i) {
+    auto const& n = nodes_[i];
+    if (n.first_token >= token_count_ || n.last_token >= token_count_) {
+      return false;
+    }
+    const bool in_bounds = n.kind == ast_kind::block
+                               ? std::uint64_t{n.lhs} + n.rhs <= child_count_
+                               : n.kind == ast_kind::decl_stmt && n.lhs < token_count_ && n.rhs < token_count_;
+    if (!in_bounds) {
+      return false;
+    }
+  }
+  for (std::size_t i = 0; i < child_count_; ++i) {
+    if (children_[i] >= node_count_) {
+      return false;
+    }
+  }
+  // every node is reached once at most from the roots, so walking them ends
+  std::vector<bool> reached(node_count_);
+  std::vector<ast_index> stack(roots_, roots_ + root_count_);
+  while (!stack.empty()) {
+    const auto i = stack.back();
+    stack.pop_back();
+    if (i >= node_count_ || reached[i]) {
+      return false;
+    }
+    reached[i] = true;
+    for (const auto child : children(i)) {
+      stack.push_back(child);
+    }
+  }
+  return true;
+}
+
+parse_cache::parse_cache(std::string directory) : directory_(std::move(directory)) {
+  std::error_code ec;
+  std::filesystem::create_directories(directory_, ec);  // a failure shows up as misses and failed stores
+}
+
+std::uint64_t parse_cache::key(std::string_view content, parser_context const& pc) {
+  return hash_bytes(content, hash_combine(pc.fingerprint(), format_version));
+}
+
+std::string parse_cache::path(std::uint64_t key) const {
+  char name[24];
+  std::snprintf(name, sizeof(name), "%016llx.mmc", static_cast<unsigned long long>(key));
+  return (std::filesystem::path(directory_) / name).string();
+}
+
+std::optional<cached_unit> parse_cache::find(std::uint64_t key, std::size_t content_size) const {
+  const auto file = path(key);
+  cached_unit unit;
+#ifdef METAMORF_MMAP
+  const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(cache_header)) {
+    close(fd);
+    return std::nullopt;
+  }
+  unit.mapping_size_ = static_cast<std::size_t>(st.st_size);
+  void* mapping = mmap(nullptr, unit.mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return std::nullopt;
+  }
+  unit.mapping_ = mapping;
+#else
+  std::ifstream in(file, std::ios::binary | std::ios::ate);
+  if (!in || static_cast<std::size_t>(in.tellg()) < sizeof(cache_header)) {
+    return std::nullopt;
+  }
+  unit.mapping_size_ = static_cast<std::size_t>(in.tellg());
+  auto* buffer = new std::uint64_t[(unit.mapping_size_ + 7) / 8];
+  unit.mapping_ = buffer;
+  in.seekg(0);
+  if (!in.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(unit.mapping_size_))) {
+    return std::nullopt;
+  }
+#endif
+
+  const auto* base = static_cast<char const*>(unit.mapping_);
+  cache_header h;
+  std::memcpy(&h, base, sizeof(h));
+  if (std::memcmp(h.magic, cache_magic, sizeof(cache_magic)) != 0 || h.version != format_version ||
+      h.byte_order != native_byte_order || h.key != key || h.content_size != content_size) {
+    return std::nullopt;
+  }
+  // each array element takes a byte at least, larger counts can't be right (and could overflow the layout)
+  const auto size = unit.mapping_size_;
+  if (h.token_count > size || h.node_count > size || h.child_count > size || h.root_count > size ||
+      h.value_count > h.token_count) {
+    return std::nullopt;
+  }
+  const auto l = layout_of(h);
+  if (l.size != size || h.checksum != checksum_of(base, size)) {
+    return std::nullopt;
+  }
+
+  unit.token_count_ = static_cast<std::size_t>(h.token_count);
+  unit.node_count_ = static_cast<std::size_t>(h.node_count);
+  unit.root_count_ = static_cast<std::size_t>(h.root_count);
+  unit.child_count_ = static_cast<std::size_t>(h.child_count);
+  unit.value_count_ = static_cast<std::size_t>(h.value_count);
+  unit.errors_ = reinterpret_cast<std::uint64_t const*>(base + l.errors);
+  unit.negatives_ = reinterpret_cast<std::uint64_t const*>(base + l.negatives);
+  unit.starts_ = reinterpret_cast<std::uint32_t const*>(base + l.starts);
+  unit.lengths_ = reinterpret_cast<std::uint32_t const*>(base + l.lengths);
+  unit.value_indices_ = reinterpret_cast<std::uint32_t const*>(base + l.value_indices);
+  unit.values_ = reinterpret_cast<std::uint64_t const*>(base + l.values);
+  unit.nodes_ = reinterpret_cast<ast_node const*>(base + l.nodes);
+  unit.children_ = reinterpret_cast<ast_index const*>(base + l.children);
+  unit.roots_ = reinterpret_cast<ast_index const*>(base + l.roots);
+  unit.kinds_ = reinterpret_cast<token_type const*>(base + l.kinds);
+  if (!unit.consistent(content_size)) {
+    return std::nullopt;
+  }
+  return unit;
+}
+
+bool parse_cache::store(std::uint64_t key, std::size_t content_size, token_buffer const& tokens,
+                        ast_arena const& arena, std::vector<ast_index> const& roots) const {
+  if (tokens.first() != 0) {
+    return false;  // a stream, the start is gone
+  }
+  if (tokens.gap() != tokens.size()) {
+    // edited, the columns end at the gap
+    auto closed = tokens;
+    closed.close_gap();
+    return store(key, content_size, closed, arena, roots);
+  }
+
+  // the values in token order, the payloads of the buffer index a table in edit order
+  std::vector<std::uint32_t> value_indices(tokens.size());
+  std::vector<std::uint64_t> values;
+  std::vector<std::uint64_t> negatives((tokens.size() + 63) / 64);
+  for (std::size_t i = 0; i < tokens.size(); ++i) {
+    if (tokens.kind(i) == token_type::numeric) {
+      value_indices[i] = static_cast<std::uint32_t>(values.size());
+      values.push_back(tokens.value(i));
+      negatives[i / 64] |= std::uint64_t{tokens.negative(i)} << (i % 64);
+    }
+  }
+
+  cache_header h{};
+  std::memcpy(h.magic, cache_magic, sizeof(cache_magic));
+  h.version = format_version;
+  h.byte_order = native_byte_order;
+  h.key = key;
+  h.content_size = content_size;
+  h.token_count = tokens.size();
+  h.node_count = arena.size();
+  h.child_count = arena.child_array().size();
+  h.root_count = roots.size();
+  h.value_count = values.size();
+  const auto l = layout_of(h);
+
+  // zero filled, so the padding is deterministic
+  std::string out(l.size, '\0');
+  std::memcpy(out.data(), &h, sizeof(h));
+  put_array(out, l.errors, tokens.error_words());
+  put_array(out, l.negatives, negatives);
+  put_array(out, l.starts, tokens.start_column());
+  put_array(out, l.lengths, tokens.length_column());
+  put_array(out, l.value_indices, value_indices);
+  put_array(out, l.values, values);
+  put_array(out, l.children, arena.child_array());
+  put_array(out, l.roots, roots);
+  put_array(out, l.kinds, tokens.kind_column());
+  auto at = l.nodes;
+  for (auto const& n : arena.node_array()) {
+    std::memcpy(out.data() + at + offsetof(ast_node, kind), &n.kind, sizeof(n.kind));
+    std::memcpy(out.data() + at + offsetof(ast_node, first_token), &n.first_token, sizeof(n.first_token));
+    std::memcpy(out.data() + at + offsetof(ast_node, last_token), &n.last_token, sizeof(n.last_token));
+    std::memcpy(out.data() + at + offsetof(ast_node, lhs), &n.lhs, sizeof(n.lhs));
+    std::memcpy(out.data() + at + offsetof(ast_node, rhs), &n.rhs, sizeof(n.rhs));
+    at += sizeof(ast_node);
+  }
+  const auto checksum = checksum_of(out.data(), out.size());
+  std::memcpy(out.data() + offsetof(cache_header, checksum), &checksum, sizeof(checksum));
+
+  const auto file = path(key);
+  const auto temporary = temporary_path(file);
+  {
+    std::ofstream f(temporary, std::ios::binary | std::ios::trunc);
+    if (!f.write(out.data(), static_cast<std::streamsize>(out.size())) || !f.flush()) {
+      f.close();
+      std::error_code ec;
+      std::filesystem::remove(temporary, ec);
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(temporary, file, ec);
+  if (ec) {
+    std::filesystem::remove(temporary, ec);
+    return false;
+  }
+  return true;
+}
@@ -1,6 +1,180 @@
 
 #include "source.hxx"
 
-void diagnostic_reporter::report(source_diagnostic diag) { messages_.push_back(diag); }
+#include <algorithm>
+#include <iterator>
+#include <thread>
+#include <tuple>
 
-diagnostic_reporter::messages_t const& diagnostic_reporter::messages() const { return messages_; }
+#include <spdlog/logger.h>
+#include <spdlog/sinks/stdout_sinks.h>
+
+#include "char_class.hxx"
+#include "instrument.hxx"
+
+line_index::line_index(std::string_view text) : line_starts_{0} {
+  find_line_starts(text.data(), text.data() + text.size(), line_starts_);
+}
+
+source_pos line_index::position(std::uint32_t offset) const noexcept {
+  // the tail descends, the lines starting at or before offset are at its end
+  const auto shift = tail_shift_;
+  const auto behind = std::partition_point(tail_starts_.begin(), tail_starts_.end(),
+                                           [shift, offset](std::uint32_t s) { return s + shift > offset; });
+  if (behind != tail_starts_.end()) {
+    const auto line = static_cast<int>(line_starts_.size() + (tail_starts_.end() - behind));
+    return {line, static_cast<int>(offset - (*behind + shift))};
+  }
+  const auto it = std::upper_bound(line_starts_.begin(), line_starts_.end(), offset);
+  const auto line = static_cast<int>(it - line_starts_.begin());
+  return {line, static_cast<int>(offset - *(it - 1))};
+}
+
+void line_index::apply_edit(std::uint32_t offset, std::uint32_t length, std::string_view replacement) {
+  // the gap moves to the edit: lines starting up to offset before it, the later ones behind it
+  const auto shift = tail_shift_;
+  const auto ahead = std::partition_point(tail_starts_.begin(), tail_starts_.end(),
+                                          [shift, offset](std::uint32_t s) { return s + shift > offset; });
+  std::transform(tail_starts_.rbegin(), std::make_reverse_iterator(ahead), std::back_inserter(line_starts_),
+                 [shift](std::uint32_t s) { return s + shift; });
+  tail_starts_.erase(ahead, tail_starts_.end());
+  const auto behind = std::upper_bound(line_starts_.begin(), line_starts_.end(), offset);
+  std::transform(line_starts_.rbegin(), std::make_reverse_iterator(behind), std::back_inserter(tail_starts_),
+                 [shift](std::uint32_t s) { return s - shift; });
+  line_starts_.erase(behind, line_starts_.end());
+
+  // the lines after the newlines of the replaced text are gone, those of the replacement are new
+  while (!tail_starts_.empty() && tail_starts_.back() + tail_shift_ <= offset + length) {
+    tail_starts_.pop_back();
+  }
+  const auto added = line_starts_.size();
+  find_line_starts(replacement.data(), replacement.data() + replacement.size(), line_starts_);
+  for (auto i = added; i < line_starts_.size(); ++i) {
+    line_starts_[i] += offset;
+  }
+  tail_shift_ += static_cast<std::uint32_t>(replacement.size() - length);
+}
+
+struct diagnostic_reporter::thread_buffer {
+  std::thread::id thread;
+  std::mutex mutex;  // only contended while the buffers are read
+  messages_t messages;
+};
+
+namespace {
+std::atomic<std::uint64_t> next_reporter_id{1};
+
+spdlog::logger& diagnostics_logger() {
+  static const auto log = [] {
+    auto l = std::make_shared<spdlog::logger>("diagnostics", std::make_shared<spdlog::sinks::stderr_sink_mt>());
+    l->set_pattern("%v");
+    return l;
+  }();
+  return *log;
+}
+}  // namespace
+
+diagnostic_reporter::diagnostic_reporter(diagnostic_limits limits)
+    : limits_(limits), id_(next_reporter_id.fetch_add(1, std::memory_order_relaxed)) {}
+
+diagnostic_reporter::diagnostic_reporter(diagnostic_reporter&& other) noexcept
+    : limits_(other.limits_)
+    , id_(next_reporter_id.fetch_add(1, std::memory_order_relaxed))
+    , buffers_(std::move(other.buffers_))
+    , errors_(other.errors_.exchange(0))
+    , suppressed_(other.suppressed_.exchange(0)) {
+  for (std::size_t i = 0; i < code_slots; ++i) {
+    per_code_[i] = other.per_code_[i].exchange(0);
+  }
+  other.buffers_.clear();
+  // threads that cached a buffer of other must not find it under its old id
+  other.id_ = next_reporter_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+diagnostic_reporter::~diagnostic_reporter() = default;
+
+std::size_t diagnostic_reporter::code_slot(int code) noexcept {
+  return code >= 0 && static_cast<std::size_t>(code) < code_slots ? static_cast<std::size_t>(code) : code_slots - 1;
+}
+
+bool diagnostic_reporter::admit(diagnostic_message const& diag) noexcept {
+  count_event(counter::diagnostics);
+  bool fits =
+      per_code_[code_slot(diag.diagnostic_code())].fetch_add(1, std::memory_order_relaxed) < limits_.max_per_code;
+  if (diag.level() == diagnostic_level::error) {
+    fits = errors_.fetch_add(1, std::memory_order_relaxed) < limits_.max_errors && fits;
+  }
+  if (!fits) {
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return fits;
+}
+
+void diagnostic_reporter::store(source_diagnostic const& diag) {
+  auto& buffer = local_buffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  buffer.messages.push_back(diag);
+}
+
+diagnostic_reporter::thread_buffer& diagnostic_reporter::local_buffer() {
+  // the buffer this thread used last, valid while the same reporter asks
+  static thread_local std::uint64_t cached_owner = 0;
+  static thread_local thread_buffer* cached = nullptr;
+  if (cached_owner == id_) {
+    return *cached;
+  }
+
+  const auto self = std::this_thread::get_id();
+  std::lock_guard<std::mutex> lock(buffers_mutex_);
+  auto it = std::find_if(buffers_.begin(), buffers_.end(), [self](auto const& b) { return b->thread == self; });
+  if (it == buffers_.end()) {
+    buffers_.push_back(std::make_unique<thread_buffer>());
+    buffers_.back()->thread = self;
+    it = buffers_.end() - 1;
+  }
+  cached_owner = id_;
+  cached = it->get();
+  return *cached;
+}
+
+diagnostic_reporter::messages_t diagnostic_reporter::messages() const {
+  std::vector<source_diagnostic const*> all;
+  std::vector<std::unique_lock<std::mutex>> locks;
+  std::lock_guard<std::mutex> lock(buffers_mutex_);
+  for (auto const& b : buffers_) {
+    locks.emplace_back(b->mutex);
+    for (auto const& d : b->messages) {
+      all.push_back(&d);
+    }
+  }
+
+  const auto key = [](source_diagnostic const* d) {
+    return std::make_tuple(d->where.start.line, d->where.start.offset, d->diag.diagnostic_code(), d->where.end.line,
+                           d->where.end.offset, d->suggestion);
+  };
+  std::stable_sort(all.begin(), all.end(), [&key](auto a, auto b) { return key(a) < key(b); });
+  all.erase(std::unique(all.begin(), all.end(), [&key](auto a, auto b) { return key(a) == key(b); }), all.end());
+
+  messages_t result;
+  result.reserve(all.size());
+  for (auto const* d : all) {
+    result.push_back(*d);
+  }
+  return result;
+}
+
+void diagnostic_reporter::render(std::string_view path) const { render(diagnostics_logger(), path); }
+
+void diagnostic_reporter::render(spdlog::logger& log, std::string_view path) const {
+  for (auto const& d : messages()) {
+    const bool error = d.diag.level() == diagnostic_level::error;
+    log.log(error ? spdlog::level::err : spdlog::level::warn, "{}:{}:{}: {}: {} [{}]", path, d.where.start.line,
+            d.where.start.offset, error ? "error" : "warning", d.diag.message(), d.diag.diagnostic_code());
+    if (!d.suggestion.empty()) {
+      log.info("{}:{}:{}: note: {}", path, d.where.start.line, d.where.start.offset, d.suggestion);
+    }
+  }
+  if (const auto dropped = suppressed(); dropped != 0) {
+    log.warn("{}: {} more diagnostics suppressed", path, dropped);
+  }
+}
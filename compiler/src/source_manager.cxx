@@ -0,0 +1,100 @@
+
+#include "source_manager.hxx"
+
+#include <cerrno>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define METAMORF_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+source_manager::~source_manager() {
+#ifdef METAMORF_MMAP
+  for (auto& f : files_) {
+    if (f.mapping != nullptr) {
+      munmap(f.mapping, f.mapping_size);
+    }
+  }
+#endif
+}
+
+file_id source_manager::add(source_file file) {
+  std::lock_guard lock(mutex_);
+  files_.push_back(std::move(file));
+  auto& added = files_.back();
+  if (!added.owned.empty()) {
+    added.content = added.owned;  // the string moved, SSO buffers with it
+  }
+  return static_cast<file_id>(files_.size() - 1);
+}
+
+file_id source_manager::load_file(std::string const& path) {
+#ifdef METAMORF_MMAP
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+
+  struct stat st {};
+  if (fstat(fd, &st) != 0) {
+    const int err = errno;
+    close(fd);
+    throw std::system_error(err, std::generic_category(), path);
+  }
+
+  if (static_cast<std::uint64_t>(st.st_size) > max_file_size) {
+    close(fd);
+    throw std::system_error(std::make_error_code(std::errc::file_too_large), path);
+  }
+  const auto size = static_cast<std::size_t>(st.st_size);
+  void* mapping = nullptr;
+  if (size != 0) {  // empty files can't be mapped
+    mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      const int err = errno;
+      close(fd);
+      throw std::system_error(err, std::generic_category(), path);
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  source_file f;
+  f.name = path;
+  f.mapping = mapping;
+  f.mapping_size = size;
+  f.content = {static_cast<const char*>(mapping), size};
+  return add(std::move(f));
+#else
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+  if (static_cast<std::uint64_t>(in.tellg()) > max_file_size) {
+    throw std::system_error(std::make_error_code(std::errc::file_too_large), path);
+  }
+  in.seekg(0);
+  return add_owned_buffer(path, {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()});
+#endif
+}
+
+file_id source_manager::add_buffer(std::string name, std::string_view content) {
+  source_file f;
+  f.name = std::move(name);
+  f.content = content;
+  return add(std::move(f));
+}
+
+file_id source_manager::add_owned_buffer(std::string name, std::string content) {
+  source_file f;
+  f.name = std::move(name);
+  f.owned = std::move(content);
+  return add(std::move(f));
+}
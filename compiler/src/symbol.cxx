@@ -0,0 +1,102 @@
+
+#include "symbol.hxx"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <mutex>
+
+namespace {
+constexpr std::size_t default_chunk_size = 64 * 1024;
+}  // namespace
+
+string_interner::string_interner()
+    : entries_{{std::string_view{}, 0}}, slots_(1024, no_symbol), chunk_used_(0), chunk_size_(0) {}
+
+string_interner& string_interner::global() {
+  static string_interner interner;
+  return interner;
+}
+
+symbol_id string_interner::lookup(std::string_view text, std::size_t hash) const noexcept {
+  const auto mask = slots_.size() - 1;
+  for (auto i = hash & mask;; i = (i + 1) & mask) {
+    const auto id = slots_[i];
+    if (id == no_symbol) {
+      return no_symbol;
+    }
+    if (entries_[id].hash == hash && entries_[id].text == text) {
+      return id;
+    }
+  }
+}
+
+symbol_id string_interner::find(std::string_view text) const noexcept {
+  const auto hash = std::hash<std::string_view>{}(text);
+  std::shared_lock lock(mutex_);
+  return lookup(text, hash);
+}
+
+symbol_id string_interner::intern(std::string_view text) {
+  const auto hash = std::hash<std::string_view>{}(text);
+  {
+    std::shared_lock lock(mutex_);
+    if (const auto id = lookup(text, hash); id != no_symbol) {
+      return id;
+    }
+  }
+
+  std::unique_lock lock(mutex_);
+  if (const auto id = lookup(text, hash); id != no_symbol) {
+    return id;  // interned by another thread in the meantime
+  }
+
+  if (entries_.size() * 2 > slots_.size()) {
+    grow();
+  }
+
+  const auto id = static_cast<symbol_id>(entries_.size());
+  entries_.push_back({store(text), hash});
+
+  const auto mask = slots_.size() - 1;
+  auto i = hash & mask;
+  while (slots_[i] != no_symbol) {
+    i = (i + 1) & mask;
+  }
+  slots_[i] = id;
+  return id;
+}
+
+std::string_view string_interner::name(symbol_id id) const noexcept {
+  std::shared_lock lock(mutex_);
+  return entries_[id].text;
+}
+
+std::size_t string_interner::size() const noexcept {
+  std::shared_lock lock(mutex_);
+  return entries_.size() - 1;
+}
+
+std::string_view string_interner::store(std::string_view text) {
+  if (chunk_used_ + text.size() > chunk_size_) {
+    chunk_size_ = std::max(default_chunk_size, text.size());
+    chunks_.push_back(std::make_unique<char[]>(chunk_size_));
+    chunk_used_ = 0;
+  }
+  char* dest = chunks_.back().get() + chunk_used_;
+  std::memcpy(dest, text.data(), text.size());
+  chunk_used_ += text.size();
+  return {dest, text.size()};
+}
+
+void string_interner::grow() {
+  slots_.assign(slots_.size() * 2, no_symbol);
+  const auto mask = slots_.size() - 1;
+  for (symbol_id id = 1; id < entries_.size(); ++id) {
+    auto i = entries_[id].hash & mask;
+    while (slots_[i] != no_symbol) {
+      i = (i + 1) & mask;
+    }
+    slots_[i] = id;
+  }
+}
@@ -0,0 +1,108 @@
+
+#include "thread_pool.hxx"
+
+#include <algorithm>
+
+namespace {
+thread_local thread_pool const* current_pool = nullptr;
+thread_local std::size_t current_index = thread_pool::npos;
+}  // namespace
+
+thread_pool::thread_pool(std::size_t threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (std::size_t i = 0; i < threads; ++i) {
+    queues_.push_back(std::make_unique<task_queue>());
+  }
+  for (std::size_t i = 0; i < threads; ++i) {
+    threads_.emplace_back([this, i] { run(i); });
+  }
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::lock_guard lock(state_mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto& t : threads_) {
+    t.join();
+  }
+}
+
+std::size_t thread_pool::current_worker() noexcept { return current_index; }
+
+void thread_pool::submit(task_t task) {
+  const auto index =
+      current_pool == this ? current_index : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+  unfinished_.fetch_add(1);
+  {
+    std::lock_guard lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(std::move(task));
+    queued_.fetch_add(1);
+  }
+  // a worker going to sleep counts itself before it checks queued_, so one of the two sees the other
+  if (sleeping_.load() != 0) {
+    std::lock_guard lock(state_mutex_);  // it is either before its check or waiting, not in between
+    work_cv_.notify_one();
+  }
+}
+
+void thread_pool::wait() {
+  std::unique_lock lock(state_mutex_);
+  done_cv_.wait(lock, [this] { return unfinished_.load() == 0; });
+}
+
+bool thread_pool::try_take(std::size_t index, task_t& task) {
+  {
+    auto& own = *queues_[index];
+    std::lock_guard lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      queued_.fetch_sub(1);
+      return true;
+    }
+  }
+  for (std::size_t i = 1; i < queues_.size(); ++i) {
+    auto& victim = *queues_[(index + i) % queues_.size()];
+    std::lock_guard lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      queued_.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool thread_pool::sleep_until_work() {
+  std::unique_lock lock(state_mutex_);
+  sleeping_.fetch_add(1);
+  work_cv_.wait(lock, [this] { return stop_ || queued_.load() != 0; });
+  sleeping_.fetch_sub(1);
+  return queued_.load() != 0;  // stopped, the queued tasks still run
+}
+
+void thread_pool::run(std::size_t index) {
+  current_pool = this;
+  current_index = index;
+
+  for (;;) {
+    task_t task;
+    if (!try_take(index, task)) {
+      if (!sleep_until_work()) {
+        return;
+      }
+      continue;
+    }
+    task();
+
+    if (unfinished_.fetch_sub(1) == 1) {
+      std::lock_guard lock(state_mutex_);
+      done_cv_.notify_all();
+    }
+  }
+}
@@ -1,6 +1,28 @@
 
 #include "tokenizer.hxx"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#if defined(_WIN32)
+#include <io.h>
+#define METAMORF_READ _read
+#else
+#include <unistd.h>
+#define METAMORF_READ ::read
+#endif
+
+#include "char_class.hxx"
+#include "instrument.hxx"
+#include "spsc_queue.hxx"
+#include "thread_pool.hxx"
+
 class contination_error_t : public diagnostic_message {
   virtual diagnostic_level level() const { return diagnostic_level::error; }
   virtual std::string message() const { return "Tokenizer error: not allowed continuation."; }
@@ -9,266 +31,762 @@ class contination_error_t : public diagnostic_message {
 
 contination_error_t contination_error;
 
+class unexpected_character_t : public diagnostic_message {
+  virtual diagnostic_level level() const { return diagnostic_level::error; }
+  virtual std::string message() const { return "Tokenizer error: unexpected character."; }
+  virtual int diagnostic_code() const { return 2; }
+};
+
+unexpected_character_t unexpected_character;
+
+class read_failure_t : public diagnostic_message {
+  virtual diagnostic_level level() const { return diagnostic_level::error; }
+  virtual std::string message() const { return "Tokenizer error: can't read the input."; }
+  virtual int diagnostic_code() const { return 3; }
+};
+
+read_failure_t read_failure;
+
+class numeric_overflow_t : public diagnostic_message {
+  virtual diagnostic_level level() const { return diagnostic_level::error; }
+  virtual std::string message() const { return "Tokenizer error: the number doesn't fit in 64 bits."; }
+  virtual int diagnostic_code() const { return 4; }
+};
+
+numeric_overflow_t numeric_overflow;
+
 namespace {
-const auto is_numeric_start = [](char c) { return c >= '0' && c <= '9'; };
-const auto is_whitespace_start = [](char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
-const auto is_operator_start = [](char c) {
-  switch (c) {
-    case '-':
-    case '+':
-    case '?':
-    case '!':
-    case '*':
-    case '/':
-    case '\\':
-    case '^':
-    case '$':
-    case '@':
-    case '%':
-    case '~':
-    case '|':
-    case '=':
-    case '<':
-    case '>':
-    case ':':
-      return true;
-    default:
-      return false;
-  }
+const auto no_operators = [](std::string_view) { return false; };
+const auto no_operator_scan = [](std::string_view) -> std::size_t { return 0; };
+
+// a part of the text for lex_parallel, lexed by whoever takes it first
+struct lex_part {
+  std::size_t begin = 0;
+  std::size_t end = 0;
+  token_buffer tokens;
+  bool stalled = false;
+  std::atomic<bool> taken{false};
 };
-const auto is_identifier_start = [](char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; };
-const auto is_identifier_inside = [](char c) { return (c >= '0' && c <= '9') || is_identifier_start(c); };
-const auto is_semicolon = [](char c) { return c == ';'; };
-const auto is_bracket = [](char c) {
-  switch (c) {
-    case '(':
-    case ')':
-    case '[':
-    case ']':
-    case '{':
-    case '}':
-      return true;
-    default:
-      return false;
+
+// shared with the pool tasks, which can outlive the call when their part was taken by another thread
+struct parallel_lex {
+  std::vector<lex_part> parts;
+  std::mutex mutex;
+  std::condition_variable done_cv;
+  std::size_t done = 0;
+
+  explicit parallel_lex(std::size_t count) : parts(count) {}
+};
+
+// a token on its way from the producer of a pipeline to the tokenizer
+struct lexed_token {
+  std::uint64_t payload;  // the symbol of identifiers, the value of numerics
+  std::uint32_t start;
+  std::uint32_t length;
+  token_type kind;
+  bool error;
+  bool negative;  // of numerics
+};
+
+// The magnitude of a numeric literal, false if it is out of range: the magnitude of a negative one can be one more
+// than the largest signed value. value is unchanged then.
+bool decode_numeric(std::string_view text, std::uint64_t& value) noexcept {
+  const bool negative = text[0] == '-';
+  std::uint64_t magnitude = 0;
+  if (!decode_digits(text.data() + negative, text.data() + text.size(), magnitude) ||
+      (negative && magnitude > std::uint64_t{1} << 63)) {
+    return false;
+  }
+  value = magnitude;
+  return true;
+}
+
+// a lookup asked once per character, for operator sets that aren't compiled
+struct prefix_scan {
+  tokenizer::lookup_t is_operator_or_prefix;
+
+  std::size_t operator()(std::string_view text) const noexcept {
+    std::size_t length = 0;
+    return scan_operator(text, [&](char) { return is_operator_or_prefix(text.substr(0, ++length)); });
   }
 };
 }  // namespace
 
+tokenizer::tokenizer(source_manager const& sources, file_id file, diagnostic_reporter& rep) noexcept
+    : filename_(sources.name(file))
+    , content_(sources.content(file))
+    , index_(0)
+    , cursor_(0)
+    , reporter_(rep)
+    , bound_lookup_(no_operators)
+    , bound_scan_(no_operator_scan) {}
+
 tokenizer::tokenizer(std::string filename, std::string content, diagnostic_reporter& rep)
+    : owned_filename_(std::move(filename))
+    , owned_content_(std::move(content))
+    , filename_(owned_filename_)
+    , content_(owned_content_)
+    , index_(0)
+    , cursor_(0)
+    , reporter_(rep)
+    , bound_lookup_(no_operators)
+    , bound_scan_(no_operator_scan) {}
+
+tokenizer::tokenizer(std::string filename, int fd, diagnostic_reporter& rep, std::size_t chunk_size)
+    : owned_filename_(std::move(filename))
+    , filename_(owned_filename_)
+    , content_(owned_content_)
+    , index_(0)
+    , cursor_(0)
+    , reporter_(rep)
+    , bound_lookup_(no_operators)
+    , bound_scan_(no_operator_scan)
+    , fd_(fd)
+    , chunk_size_(std::max<std::size_t>(chunk_size, 1))
+    , exhausted_(false) {}
+
+// the producer lexes on its own tokenizer over the same text, and reports to the same reporter
+struct tokenizer::pipeline {
+  pipeline(tokenizer& owner, std::size_t lookahead)
+      : queue(lookahead), lexer(owner.filename_, owner.content_, owner.reporter_, owner.bound_scan_) {}
+
+  spsc_queue<lexed_token> queue;
+  std::atomic<bool> stop{false};
+  std::atomic<bool> done{false};  // the last token was pushed
+  tokenizer lexer;
+  std::thread producer;
+};
 
-    : filename_(filename), content_(content), index_(0), position_{1, 0}, reporter_(rep) {}
+tokenizer::tokenizer(std::string_view filename, std::string_view content, diagnostic_reporter& rep,
+                     scan_t scan) noexcept
+    : filename_(filename)
+    , content_(content)
+    , index_(0)
+    , cursor_(0)
+    , reporter_(rep)
+    , bound_lookup_(no_operators)
+    , bound_scan_(scan) {}
+
+tokenizer::~tokenizer() { stop_pipeline(); }
+
+token tokenizer::next_token(lookup_t is_operator_or_prefix) noexcept {
+  const prefix_scan scan{is_operator_or_prefix};
+  return next_token(operator_scanner{scan});
+}
 
-token const& tokenizer::next_token(lookup_t is_operator_or_prefix) noexcept {
-  if (!tokens_.empty()) {
-    auto& curr = *(--tokens_.end());
-    if (curr.type == token_type::eof) {
-      return curr;
-    }
+token tokenizer::next_token(operator_scanner scanner) noexcept {
+  if (cursor_ == tokens_.size() && pipeline_ != nullptr) {
+    fetch();
+  }
+  if (cursor_ < tokens_.size()) {
+    return token_at(cursor_++);
+  }
+
+  if (tokens_.size() > tokens_.first() && tokens_.kind(tokens_.size() - 1) == token_type::eof) {
+    return token_at(tokens_.size() - 1);
+  }
+
+  need_input();
+  const auto tok = lex_token(scanner.scan, tokens_);
+  cursor_ = tokens_.size();
+  return tok;
+}
+
+std::size_t tokenizer::scan_bound_lookup(std::string_view text) const noexcept {
+  return prefix_scan{bound_lookup_}(text);
+}
+
+token tokenizer::lex_token(scan_t scan, token_buffer& into) noexcept {
+  const auto saved_index = index_;
+  auto [type, error] = create_token(scan);
+  const auto text = content_.substr(saved_index, index_ - saved_index);
+
+  symbol_id symbol = no_symbol;
+  std::uint64_t payload = 0;
+  bool negative = false;
+  if (type == token_type::identifier || type == token_type::function_identifier) {
+    symbol = string_interner::global().intern(text);
+    payload = symbol;
+  } else if (type == token_type::numeric && !error) {
+    error = !decode_numeric(text, payload);
+    negative = text[0] == '-';
   }
+  diagnose(type, error, saved_index, index_);
 
-  tokens_.push_back(create_token(is_operator_or_prefix));
+  into.push_back(type, static_cast<std::uint32_t>(saved_index), static_cast<std::uint32_t>(text.size()), error,
+                 payload, negative);
+  count_token(type);
 
-  return *(--tokens_.end());
+  return {type, text, error, symbol, type == token_type::numeric ? payload : 0, negative};
 }
 
-const token* tokenizer::skip_whitespace() noexcept {
-  if (index_ < content_.size() && is_whitespace_start(content_[index_])) {
-    return &next_token([](std::string_view) { return false; });
+std::optional<token> tokenizer::skip_whitespace() noexcept {
+  if (cursor_ >= tokens_.size()) {
+    if (pipeline_ != nullptr) {
+      fetch();
+    }
+    need_input();
+  }
+  const bool whitespace = cursor_ < tokens_.size()
+                              ? tokens_.kind(cursor_) == token_type::whitespace
+                              : index_ < content_.size() && has_class(content_[index_], cc_whitespace);
+  if (whitespace) {
+    return next_token(operator_scanner{no_operator_scan});
   }
-  return nullptr;
+  return std::nullopt;
 }
 
-bool tokenizer::try_operator(lookup_t is_operator_or_prefix) noexcept {
-  const char* start_pos = &content_[index_];
-  std::size_t len = 1;
+bool tokenizer::lex_rest(scan_t scan) noexcept {
+  for (;;) {
+    need_input();
+    const auto before = index_;
+    const auto tok = lex_token(scan, tokens_);
+    if (tok.type == token_type::eof) {
+      return true;
+    }
+    if (index_ == before) {
+      return false;
+    }
+  }
+}
 
-  char next = content_[index_];
+void tokenizer::lex_parallel(thread_pool& pool, std::size_t parts) {
+  const bool at_end = cursor_ == tokens_.size();
+  if (at_end && tokens_.size() > tokens_.first() && tokens_.kind(tokens_.size() - 1) == token_type::eof) {
+    return;
+  }
+  if (!at_end || fd_ >= 0 || pipeline_ != nullptr) {
+    while (true) {
+      const auto tok = next_token();
+      if (tok.type == token_type::eof || tok.text.empty()) {
+        return;
+      }
+    }
+  }
 
-  if (!is_operator_start(next)) {
-    return false;
+  // Parts start at the first whitespace of a run with a newline: no token spans whitespace, so the one before ends
+  // there, and the run is one token in both passes. Continuation checks at the end of a part see the end of the text,
+  // which is allowed wherever whitespace is.
+  std::vector<std::size_t> bounds{index_};
+  const auto length = content_.size() - index_;
+  for (std::size_t k = 1; k < parts; ++k) {
+    auto at = content_.find('\n', std::max(index_ + length / parts * k, bounds.back() + 1));
+    if (at == std::string_view::npos) {
+      break;
+    }
+    while (at > bounds.back() && has_class(content_[at - 1], cc_whitespace)) {
+      --at;
+    }
+    if (at > bounds.back()) {
+      bounds.push_back(at);
+    }
   }
+  bounds.push_back(content_.size());
 
-  while (is_operator_start(next) && is_operator_or_prefix({start_pos, len}) && index_ < content_.size()) {
-    // possible symbols at the end
-    // no greedy checks here: func names can't be concatenated with operators directly
-    index_++;
-    next = content_[index_];
-    position_.offset++;
-    len++;
+  if (bounds.size() == 2) {
+    lex_rest(bound_scan_);
+    cursor_ = tokens_.size();
+    return;
   }
 
-  // after the symbols, there can be identifier characters
-  while (is_identifier_inside(next) && is_operator_or_prefix({start_pos, len}) && index_ < content_.size()) {
-    index_++;
-    next = content_[index_];
-    position_.offset++;
-    len++;
+  auto state = std::make_shared<parallel_lex>(bounds.size() - 1);
+  for (std::size_t i = 0; i < state->parts.size(); ++i) {
+    state->parts[i].begin = bounds[i];
+    state->parts[i].end = bounds[i + 1];
   }
 
-  // and this can be followed by operator symbols again
-  while (is_operator_start(next) && is_operator_or_prefix({start_pos, len}) && index_ < content_.size()) {
-    index_++;
-    next = content_[index_];
-    position_.offset++;
-    len++;
+  const auto run = [filename = filename_, content = content_, scan = bound_scan_](parallel_lex& s, lex_part& part) {
+    if (part.taken.exchange(true, std::memory_order_acq_rel)) {
+      return;
+    }
+    // tokens and diagnostics are counted once, while stitching: past its cap of 0, silent only counts
+    auto* const track = std::exchange(current_track(), nullptr);
+    diagnostic_reporter silent({0, 0});
+    tokenizer t(filename, content.substr(part.begin, part.end - part.begin), silent, scan);
+    part.stalled = !t.lex_rest(scan);
+    part.tokens = std::move(t.tokens_);
+    current_track() = track;
+
+    std::lock_guard lock(s.mutex);
+    ++s.done;
+    s.done_cv.notify_all();
+  };
+  for (std::size_t i = 1; i < state->parts.size(); ++i) {
+    pool.submit([state, run, i] { run(*state, state->parts[i]); });
+  }
+  // the calling thread takes the parts no worker started yet, so this can't wait on a busy pool
+  for (auto& part : state->parts) {
+    run(*state, part);
+  }
+  {
+    std::unique_lock lock(state->mutex);
+    state->done_cv.wait(lock, [&state] { return state->done == state->parts.size(); });
   }
 
+  // the eof of every part but the last is dropped, a stalled part ends the text
+  std::size_t total = 0;
+  for (auto const& part : state->parts) {
+    total += part.tokens.size();
+  }
+  tokens_.reserve(tokens_.size() + total);
+  for (auto const& part : state->parts) {
+    const bool last = part.stalled || &part == &state->parts.back();
+    const auto count = last ? part.tokens.size() : part.tokens.size() - 1;
+    const auto first = tokens_.size();
+    tokens_.append(part.tokens, count, static_cast<std::uint32_t>(part.begin));
+    for (auto i = first; i < tokens_.size(); ++i) {
+      count_token(tokens_.kind(i));
+      diagnose(tokens_.kind(i), tokens_.error(i), tokens_.start(i), tokens_.end(i));
+    }
+    if (last) {
+      break;
+    }
+  }
+  index_ = tokens_.end(tokens_.size() - 1);
+  cursor_ = tokens_.size();
+}
+
+void tokenizer::start_pipeline(std::size_t lookahead) {
+  if (pipeline_ != nullptr || fd_ >= 0) {
+    return;
+  }
+  if (tokens_.size() != 0 && tokens_.kind(tokens_.size() - 1) == token_type::eof) {
+    return;
+  }
+  pipeline_ = std::make_unique<pipeline>(*this, lookahead);
+  pipeline_->lexer.index_ = index_;
+  pipeline_->lexer.diagnosed_to_ = diagnosed_to_;
+  pipeline_->producer = std::thread([p = pipeline_.get()] { p->lexer.produce(*p); });
+}
+
+void tokenizer::stop_pipeline() noexcept {
+  if (pipeline_ == nullptr) {
+    return;
+  }
+  pipeline_->stop.store(true, std::memory_order_relaxed);
+  pipeline_->producer.join();
+  // the dropped tokens are lexed again here, their errors were reported by the producer
+  diagnosed_to_ = std::max(diagnosed_to_, pipeline_->lexer.diagnosed_to_);
+  pipeline_.reset();
+}
+
+void tokenizer::produce(pipeline& p) noexcept {
+  for (;;) {
+    const auto before = index_;
+    const auto tok = lex_token(bound_scan_, tokens_);
+    const auto payload = tok.type == token_type::numeric ? tok.value : tok.symbol;
+    const lexed_token lexed{payload, static_cast<std::uint32_t>(before), static_cast<std::uint32_t>(tok.text.size()),
+                            tok.type, tok.error, tok.negative};
+    if (tokens_.size() == 1024) {
+      tokens_.truncate(0);  // only the queue keeps them
+    }
+    while (!p.queue.try_push(lexed)) {
+      if (p.stop.load(std::memory_order_relaxed)) {
+        return;
+      }
+      std::this_thread::yield();
+    }
+    if (tok.type == token_type::eof || index_ == before) {
+      break;
+    }
+  }
+  p.done.store(true, std::memory_order_release);
+}
+
+bool tokenizer::fetch() noexcept {
+  auto& p = *pipeline_;
+  lexed_token lexed{};
+  for (;;) {
+    if (p.queue.try_pop(lexed)) {
+      break;
+    }
+    // everything pushed before done is visible after it
+    if (p.done.load(std::memory_order_acquire)) {
+      if (p.queue.try_pop(lexed)) {
+        break;
+      }
+      stop_pipeline();
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  tokens_.push_back(lexed.kind, lexed.start, lexed.length, lexed.error, lexed.payload, lexed.negative);
+  index_ = lexed.start + lexed.length;
+  count_token(lexed.kind);
+  if (lexed.kind == token_type::eof || lexed.length == 0) {
+    stop_pipeline();  // the producer's last token
+  }
   return true;
 }
 
-bool tokenizer::try_whitespace() noexcept {
-  const auto old_idx = index_;
+token_edit tokenizer::apply_edit(text_edit const& edit) {
+  owned_content_.replace(edit.offset, edit.length, edit.replacement);
+  return apply_edit(edit, owned_content_);
+}
 
-  char next = content_[index_];
+token_edit tokenizer::apply_edit(text_edit const& edit, std::string_view new_content) {
+  stop_pipeline();
+  if (fd_ >= 0) {
+    return {tokens_.size(), 0, 0};  // streams have no whole text to edit
+  }
 
-  while (is_whitespace_start(next) && index_ < content_.size()) {
-    index_++;
-    position_.offset++;
-    if (next == '\n') {
-      position_.offset = 0;
-      position_.line++;
+  const auto size = tokens_.size();
+  const auto shift = static_cast<std::int64_t>(edit.replacement.size()) - edit.length;
+  const auto old_edit_end = edit.offset + edit.length;
+  const auto new_edit_end = edit.offset + edit.replacement.size();
+  const bool complete = size != 0 && tokens_.kind(size - 1) == token_type::eof;
+  const std::size_t old_frontier = size != 0 ? tokens_.end(size - 1) : 0;
+
+  const auto partition = [this](std::size_t lo, std::size_t hi, auto before) {
+    while (lo < hi) {
+      const auto mid = lo + (hi - lo) / 2;
+      if (before(mid)) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  };
+
+  content_ = new_content;
+  if (lines_) {
+    lines_->apply_edit(edit.offset, edit.length, edit.replacement);
+  }
+
+  // the errors behind the edit were reported, and move with it; the lexing frontier is lowered to what is
+  // lexed again
+  const auto diagnosed = diagnosed_to_;
+  const auto diagnosed_behind = diagnosed > old_edit_end ? static_cast<std::uint64_t>(diagnosed + shift) : 0;
+
+  // a token is affected if its text, or the character after it (continuation checks), is in the edit
+  const auto first = partition(0, size, [this, &edit](std::size_t i) { return tokens_.end(i) < edit.offset; });
+  if (first == size) {
+    // lexed on demand from the frontier on, the token at the edit starts after whitespace
+    auto from = std::max<std::size_t>(edit.offset, old_frontier);
+    while (from > old_frontier && !has_class(content_[from - 1], cc_whitespace)) {
+      --from;
+    }
+    diagnosed_to_ = std::min<std::uint64_t>(diagnosed, from);
+    return {size, 0, 0};  // the edit is past everything lexed so far
+  }
+  diagnosed_to_ = std::min<std::uint64_t>(diagnosed, tokens_.start(first));
+
+  // old tokens starting after the edit, where the streams can meet again
+  auto candidate =
+      partition(first, size, [this, old_edit_end](std::size_t i) { return tokens_.start(i) < old_edit_end; });
+
+  token_buffer fresh;
+  auto resume = size;
+  index_ = tokens_.start(first);
+  for (;;) {
+    const auto before = index_;
+    const auto tok = lex_token(bound_scan_, fresh);
+    if (tok.type == token_type::eof || index_ == before) {
+      break;  // end of text, or an operator that can't make progress: the old tail is dropped
+    }
+    if (index_ < new_edit_end) {
+      continue;
+    }
+    const auto old_index = static_cast<std::size_t>(static_cast<std::int64_t>(index_) - shift);
+    while (candidate < size && tokens_.start(candidate) < old_index) {
+      ++candidate;
+    }
+    if (candidate < size && tokens_.start(candidate) == old_index) {
+      resume = candidate;
+      break;
+    }
+    if (!complete && old_index >= old_frontier) {
+      break;  // past the old lexing frontier, the rest is lexed on demand
     }
-    next = content_[index_];
   }
 
-  return old_idx != index_;
+  tokens_.splice(first, resume, fresh, shift);
+  index_ = tokens_.empty() ? 0 : tokens_.end(tokens_.size() - 1);
+  diagnosed_to_ = std::max(diagnosed_to_, diagnosed_behind);
+  // a cursor behind the edit keeps its token, one inside it goes back to the first changed token
+  if (cursor_ >= resume) {
+    cursor_ = cursor_ - resume + first + fresh.size();
+  } else {
+    cursor_ = std::min(cursor_, first);
+  }
+
+  return {first, resume - first, fresh.size()};
 }
 
-bool tokenizer::try_numeric() noexcept {
-  const auto old_idx = index_;
+source_pos tokenizer::position(std::uint32_t offset) const {
+  if (!lines_) {
+    lines_.emplace(content_);
+  }
+  // a streaming window starts after base_line_ lines, maybe in the middle of one
+  auto pos = lines_->position(offset);
+  if (pos.line == 1) {
+    pos.offset = static_cast<int>(text_base_ + offset - base_line_start_);
+  }
+  pos.line += static_cast<int>(base_line_);
+  return pos;
+}
 
-  char next = content_[index_];
+void tokenizer::fill() noexcept {
+  release();
+  while (index_ >= safe_end_ && !exhausted_) {
+    const auto old_size = owned_content_.size();
+    owned_content_.resize(old_size + chunk_size_);
+    long n = 0;
+    do {
+      n = static_cast<long>(METAMORF_READ(fd_, owned_content_.data() + old_size, chunk_size_));
+    } while (n < 0 && errno == EINTR);
+    owned_content_.resize(old_size + static_cast<std::size_t>(std::max(n, 0L)));
+    content_ = owned_content_;
+    lines_.reset();
+
+    if (n <= 0) {
+      exhausted_ = true;
+      safe_end_ = owned_content_.size();
+      if (n < 0) {
+        reporter_.report(read_failure, [this, old_size] { return span(old_size, old_size); });
+      }
+      break;
+    }
 
-  if (next == '-' && index_ + 1 < content_.size() && is_numeric_start(content_[index_ + 1])) {
-    index_++;
-    next = content_[index_];
-    position_.offset++;
+    // Every token lies in a run of whitespace or of other characters, so tokens starting before the last change
+    // between the two end in the window, and so does their continuation check. [index_, old_size) was one run,
+    // the last change is in the new text or at its border.
+    safe_end_ = index_;
+    const auto is_ws = [this](std::size_t i) { return has_class(owned_content_[i], cc_whitespace); };
+    for (auto i = owned_content_.size() - 1; i > index_ && i >= old_size; --i) {
+      if (is_ws(i) != is_ws(i - 1)) {
+        safe_end_ = i;
+        break;
+      }
+    }
   }
+}
 
-  while (is_numeric_start(next) && index_ < content_.size()) {
-    index_++;
-    next = content_[index_];
-    position_.offset++;
+void tokenizer::release() {
+  auto keep = cursor_;
+  for (auto const* c = checkpoints_; c != nullptr; c = c->older_) {
+    keep = std::min(keep, c->cursor_);
+  }
+  if (tokens_.size() != 0) {
+    keep = std::min(keep, tokens_.size() - 1);  // the last one, for the eof check
+  }
+  const std::size_t keep_text = keep < tokens_.size() ? tokens_.start(keep) : index_;
+
+  // only when at least half of the window goes, so the moves are amortized
+  if (keep_text == 0 || keep_text < owned_content_.size() / 2) {
+    return;
   }
 
-  return old_idx != index_;
+  const auto dropped = std::string_view(owned_content_).substr(0, keep_text);
+  if (const auto newlines = std::count(dropped.begin(), dropped.end(), '\n'); newlines != 0) {
+    base_line_ += static_cast<std::uint64_t>(newlines);
+    base_line_start_ = text_base_ + dropped.rfind('\n') + 1;
+  }
+  owned_content_.erase(0, keep_text);
+  content_ = owned_content_;
+  lines_.reset();
+  text_base_ += keep_text;
+  index_ -= keep_text;
+  safe_end_ = safe_end_ > keep_text ? safe_end_ - keep_text : 0;
+  tokens_.release(keep, static_cast<std::uint32_t>(keep_text));
+}
+
+source_range tokenizer::span(std::size_t from, std::size_t to) const {
+  return {position(static_cast<std::uint32_t>(from)), position(static_cast<std::uint32_t>(to))};
+}
+
+source_range tokenizer::range(token const& t) const {
+  const auto start = static_cast<std::size_t>(t.text.data() - content_.data());
+  return span(start, start + t.text.size());
+}
+
+bool tokenizer::try_operator(scan_t scan) noexcept {
+  if (!has_class(content_[index_], cc_operator)) {
+    return false;
+  }
+  index_ += scan(content_.substr(index_));
+  return true;
+}
+
+bool tokenizer::try_whitespace() noexcept {
+  const char* const start_pos = content_.data() + index_;
+  const char* const next = scan_whitespace(start_pos, content_.data() + content_.size());
+
+  if (next == start_pos) {
+    return false;
+  }
+
+  index_ += next - start_pos;
+
+  return true;
+}
+
+bool tokenizer::try_numeric() noexcept {
+  const char* const start_pos = content_.data() + index_;
+  const char* const end = content_.data() + content_.size();
+  const char* next = start_pos;
+
+  if (*next == '-' && end - next > 1 && has_class(next[1], cc_digit)) {
+    ++next;
+  }
+
+  next = scan_digits(next, end);
+
+  index_ += next - start_pos;
+
+  return next != start_pos;
 }
 
 token_type tokenizer::try_identifier() noexcept {
   // identifiers start with alphabet or _, continue with alphabet+number+_, and also can end with symbols
 
-  char next = content_[index_];
+  const char* const start_pos = content_.data() + index_;
+  const char* const end = content_.data() + content_.size();
 
-  if (!is_identifier_start(next)) {
+  if (!has_class(*start_pos, cc_identifier_start)) {
     return token_type::unknown;
   }
 
-  while (is_identifier_inside(next) && index_ < content_.size()) {
-    index_++;
-    next = content_[index_];
-    position_.offset++;
-  }
-
-  const auto old_idx = index_;
+  const char* const name_end = scan_identifier(start_pos, end);
+  const char* next = name_end;
 
-  while (is_operator_start(next) && index_ < content_.size()) {
-    // possible symbols at the end
-    // no greedy checks here: func names can't be concatenated with operators directly
-    index_++;
-    next = content_[index_];
-    position_.offset++;
+  // possible symbols at the end
+  // no greedy checks here: func names can't be concatenated with operators directly
+  while (next != end && has_class(*next, cc_operator)) {
+    ++next;
   }
 
-  return old_idx != index_ ? token_type::function_identifier : token_type::identifier;
+  index_ += next - start_pos;
+
+  return next != name_end ? token_type::function_identifier : token_type::identifier;
 }
 
-token tokenizer::create_token(lookup_t is_operator_or_prefix) noexcept {
+std::pair<token_type, bool> tokenizer::create_token(scan_t scan) noexcept {
   // actually create the token...
 
   // Assumption:
-  // 1. position_ points to the next character to be read
+  // 1. index_ points to the next character to be read
   // 2. so far the input was correct
   // 3. we don't try to read after EOF
 
   if (index_ == content_.size()) {
-    return {token_type::eof, {position_, position_}, "", false};
+    return {token_type::eof, false};
   }
 
   const char next = content_[index_];
 
   const auto saved_index = index_;
-  const auto saved_position = position_;
 
-  if (is_semicolon(next)) {
+  if (has_class(next, cc_semicolon)) {
     index_++;
-    position_.offset++;
-    return {
-        token_type::semicolon, {saved_position, position_}, {&(content_[saved_index]), index_ - saved_index}, false};
+    return {token_type::semicolon, false};
   }
 
-  if (is_bracket(next)) {
+  if (has_class(next, cc_bracket)) {
     index_++;
-    position_.offset++;
-    return {token_type::bracket, {saved_position, position_}, {&(content_[saved_index]), index_ - saved_index}, false};
+    return {token_type::bracket, false};
   }
 
   if (try_whitespace()) {
-    return {
-        token_type::whitespace, {saved_position, position_}, {&(content_[saved_index]), index_ - saved_index}, false};
+    return {token_type::whitespace, false};
   }
 
   {
     const auto tt = try_identifier();
     if (tt != token_type::unknown) {
-      const bool allowed_continuation = !check_continuation(is_whitespace_start, is_semicolon);
-      const source_range range = {saved_position, position_};
-      if (!allowed_continuation) {
-        reporter_.report({contination_error, range, ""});
-      }
-      return {tt,
-              range,
-              {&(content_[saved_index]), index_ - saved_index},
-              allowed_continuation};  // TODO: parenthesis also: (, [, ... ?
+      return {tt, !check_continuation(cc_whitespace | cc_semicolon)};  // TODO: parenthesis also: (, [, ... ?
     }
   }
 
   if (try_numeric()) {
-    return {token_type::numeric,
-            {saved_position, position_},
-            {&(content_[saved_index]), index_ - saved_index},
-            !check_continuation(is_whitespace_start, is_operator_start, is_semicolon)};
+    return {token_type::numeric, !check_continuation(cc_whitespace | cc_operator | cc_semicolon)};
   }
 
-  if (try_operator(is_operator_or_prefix)) {
+  if (try_operator(scan)) {
     return {token_type::oper,
-            {saved_position, position_},
-            {&(content_[saved_index]), index_ - saved_index},
-            !check_continuation(is_whitespace_start, is_operator_start, is_numeric_start, is_identifier_start,
-                                is_semicolon) ||
+            !check_continuation(cc_whitespace | cc_operator | cc_digit | cc_identifier_start | cc_semicolon) ||
                 index_ == saved_index};
   }
 
-  return {};  // assert!
+  // not part of the language: skip a single character, so lexing can go on
+  index_++;
+  return {token_type::unknown, true};
 }
 
-template <typename... T>
-bool tokenizer::check_continuation(T... fs) noexcept {
+void tokenizer::diagnose(token_type type, bool error, std::size_t from, std::size_t to) {
+  if (!error) {
+    return;
+  }
+  // text lexed again after a rollback was reported the first time
+  const auto start = text_base_ + from;
+  if (start < diagnosed_to_) {
+    return;
+  }
+  diagnosed_to_ = start + 1;
+
+  diagnostic_message const* diag = nullptr;
+  if (type == token_type::identifier || type == token_type::function_identifier) {
+    diag = &contination_error;
+  } else if (type == token_type::unknown) {
+    diag = &unexpected_character;
+  } else if (type == token_type::numeric) {
+    // other erroneous numerics are continuation errors, left to the parser
+    std::uint64_t value = 0;
+    if (!decode_numeric(content_.substr(from, to - from), value)) {
+      diag = &numeric_overflow;
+    }
+  }
+  if (diag == nullptr) {
+    return;
+  }
+  // past the error cap this is only counted, the positions are not looked up
+  if (reporter_.error_cap_reached()) {
+    reporter_.count_suppressed_error();
+    return;
+  }
+  reporter_.report(*diag, [this, from, to] { return span(from, to); });
+}
+
+bool tokenizer::check_continuation(std::uint8_t allowed_classes) const noexcept {
   if (index_ == content_.size()) {
     return true;  // end of file is always allowed
   }
-  char next = content_[index_];
-  return (fs(next) || ...);
+  return has_class(content_[index_], allowed_classes);
 }
 
-tokenizer::checkpointer::checkpointer(tokenizer& t) noexcept
-    : t_(t), index_(t.index_), position_(t.position_), vec_size_(t.tokens_.size()) {}
+tokenizer::checkpointer::checkpointer(tokenizer& t, bool keep_tokens) noexcept
+    : t_(t)
+    , index_(t.text_base_ + t.index_)
+    , vec_size_(t.tokens_.size())
+    , cursor_(t.cursor_)
+    , keep_tokens_(keep_tokens || t.pipeline_ != nullptr)  // pipelined tokens don't depend on the parse
+    , older_(t.checkpoints_) {
+  if (older_ != nullptr) {
+    older_->newer_ = this;
+  }
+  t.checkpoints_ = this;
+}
 
 void tokenizer::checkpointer::commit() noexcept { index_ = npos; }
 
 tokenizer::checkpointer::~checkpointer() {
   if (index_ != npos) {
-    t_.index_ = index_;
-    t_.position_ = position_;
-    t_.tokens_.resize(vec_size_);
+    count_event(counter::rollbacks);
+    if (!keep_tokens_) {
+      count_event(counter::discarded_tokens, t_.tokens_.size() - vec_size_);
+      t_.index_ = static_cast<std::size_t>(index_ - t_.text_base_);
+      t_.tokens_.truncate(vec_size_);
+    }
+    t_.cursor_ = cursor_;
+  }
+
+  if (newer_ != nullptr) {
+    newer_->older_ = older_;
+  } else {
+    t_.checkpoints_ = older_;
+  }
+  if (older_ != nullptr) {
+    older_->newer_ = newer_;
   }
 }
@@ -0,0 +1,229 @@
+
+#include "corpus.hxx"
+
+#include <array>
+#include <random>
+
+namespace {
+
+constexpr std::array<std::string_view, 8> types{"u8", "u16", "u32", "u64", "s8", "s16", "s32", "s64"};
+
+// std::mt19937 is specified bit for bit, the distributions are not: only raw draws are used
+class generator {
+ public:
+  generator(std::string& out, std::uint32_t seed) : out_(out), rng_(seed) {}
+
+  std::uint32_t below(std::uint32_t n) { return static_cast<std::uint32_t>(rng_() % n); }
+
+  void name(std::size_t length) {
+    static constexpr std::string_view first = "abcdefghijklmnopqrstuvwxyz_";
+    static constexpr std::string_view rest = "abcdefghijklmnopqrstuvwxyz_0123456789";
+    out_ += first[below(first.size())];
+    for (std::size_t i = 1; i < length; ++i) {
+      out_ += rest[below(rest.size())];
+    }
+  }
+
+  void number() {
+    if (below(4) == 0) {
+      out_ += '-';
+    }
+    out_ += std::to_string(below(100000));
+  }
+
+  // a short value of types[type], negative ones only for the signed types
+  void number(std::size_t type) {
+    const auto bits = 8u << (type % 4);
+    const bool is_signed = type >= 4;
+    const bool negative = is_signed && below(4) == 0;
+    const auto value_bits = is_signed ? bits - 1 : bits;
+    const std::uint64_t limit = value_bits < 17 ? std::uint64_t{1} << value_bits : 100000;
+    if (negative) {
+      out_ += '-';
+    }
+    out_ += std::to_string(below(static_cast<std::uint32_t>(limit + (negative ? 1 : 0))));
+  }
+
+  // any value of types[type], with as many digits as the type allows
+  void wide_number(std::size_t type) {
+    const auto bits = 8u << (type % 4);
+    const bool is_signed = type >= 4;
+    const auto value_bits = is_signed ? bits - 1 : bits;
+    const auto draw = (std::uint64_t{rng_()} << 32 | rng_()) >> (64 - value_bits + below(value_bits));
+    if (is_signed && below(2) == 0) {
+      out_ += '-';
+    }
+    out_ += std::to_string(draw);
+  }
+
+  // <type> <name> = <value>, ended by a newline or a semicolon
+  void declaration(std::size_t name_length, std::string_view indent) {
+    out_ += indent;
+    const auto type = below(types.size());
+    out_ += types[type];
+    out_ += ' ';
+    name(name_length);
+    out_ += " = ";
+    number(type);
+    out_ += below(2) == 0 ? "\n" : ";\n";
+  }
+
+  void declarations() {
+    out_ += "{\n";
+    for (auto n = 4 + below(12); n != 0; --n) {
+      declaration(1 + below(3), "  ");
+    }
+    out_ += "}\n";
+  }
+
+  void identifiers() {
+    out_ += "{\n";
+    for (auto n = 2 + below(6); n != 0; --n) {
+      declaration(24 + below(72), "  ");
+    }
+    out_ += "}\n";
+  }
+
+  void nesting() {
+    const auto depth = 8 + below(40);
+    for (std::uint32_t d = 0; d < depth; ++d) {
+      out_.append(d, ' ');
+      out_ += "{ ";
+      declaration(1 + below(4), "");
+    }
+    for (auto d = depth; d-- != 0;) {
+      out_.append(d, ' ');
+      out_ += "}\n";
+    }
+  }
+
+  void whitespace() {
+    static constexpr std::array<std::string_view, 5> pads{"\n\n", "\t", "        ", "\t  \t", "\n    \n\t\n"};
+    out_ += "{";
+    for (auto n = 2 + below(6); n != 0; --n) {
+      out_ += pads[below(pads.size())];
+      const auto type = below(types.size());
+      out_ += types[type];
+      out_ += pads[1 + below(3)];
+      name(1 + below(6));
+      out_ += pads[1 + below(3)];
+      out_ += "=";
+      out_ += pads[1 + below(3)];
+      number(type);
+      out_ += pads[1 + below(3)];
+      out_ += ";";
+    }
+    out_ += pads[below(pads.size())];
+    out_ += "}\n";
+  }
+
+  // long runs of initializers over the whole range of their types, like generated data tables
+  void tables() {
+    out_ += "{\n";
+    for (auto n = 16 + below(48); n != 0; --n) {
+      const auto type = below(types.size());
+      out_ += "  ";
+      out_ += types[type];
+      out_ += ' ';
+      name(1 + below(3));
+      out_ += " = ";
+      wide_number(type);
+      out_ += ";\n";
+    }
+    out_ += "}\n";
+  }
+
+  void operators() {
+    auto const& ops = corpus_operators();
+    for (auto n = 4 + below(12); n != 0; --n) {
+      name(1 + below(4));
+      for (auto terms = 2 + below(6); terms != 0; --terms) {
+        out_ += ' ';
+        out_ += ops[below(static_cast<std::uint32_t>(ops.size()))];
+        out_ += ' ';
+        if (below(3) == 0) {
+          number();
+        } else {
+          name(1 + below(4));
+        }
+      }
+      out_ += ";\n";
+    }
+  }
+
+ private:
+  std::string& out_;
+  std::mt19937 rng_;
+};
+
+}  // namespace
+
+std::string generate_corpus(corpus_options const& options) {
+  std::string text;
+  text.reserve(options.bytes + 4096);
+  generator g(text, options.seed);
+  while (text.size() < options.bytes) {
+    auto mix = options.mix;
+    if (mix == corpus_mix::mixed) {
+      static constexpr std::array<corpus_mix, 4> parts{corpus_mix::declarations, corpus_mix::identifiers,
+                                                       corpus_mix::nesting, corpus_mix::whitespace};
+      mix = parts[g.below(parts.size())];
+    }
+    switch (mix) {
+      case corpus_mix::declarations:
+        g.declarations();
+        break;
+      case corpus_mix::operators:
+        g.operators();
+        break;
+      case corpus_mix::identifiers:
+        g.identifiers();
+        break;
+      case corpus_mix::nesting:
+        g.nesting();
+        break;
+      case corpus_mix::tables:
+        g.tables();
+        break;
+      case corpus_mix::whitespace:
+      case corpus_mix::mixed:
+        g.whitespace();
+        break;
+    }
+  }
+  return text;
+}
+
+bool corpus_parseable(corpus_mix mix) noexcept { return mix != corpus_mix::operators; }
+
+std::vector<std::string_view> const& corpus_operators() {
+  // only characters of the operator class (char_class.hxx), anything else lexes as an error
+  static const std::vector<std::string_view> ops{"=", "+", "-", "*", "/", "==", "!=", "<=", ">=", "<<", ">>",
+                                                 "<<=", "+=", "-=", "->", "%", "||", "<", ">", "~", "|"};
+  return ops;
+}
+
+namespace {
+constexpr std::array<std::string_view, 7> mix_names{"declarations", "operators", "identifiers", "nesting",
+                                                    "whitespace",   "tables",    "mixed"};
+}
+
+std::string_view corpus_mix_name(corpus_mix mix) noexcept { return mix_names[static_cast<std::size_t>(mix)]; }
+
+bool parse_corpus_mix(std::string_view name, corpus_mix& mix) noexcept {
+  for (std::size_t i = 0; i < mix_names.size(); ++i) {
+    if (mix_names[i] == name) {
+      mix = static_cast<corpus_mix>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<corpus_mix> const& all_corpus_mixes() {
+  static const std::vector<corpus_mix> mixes{corpus_mix::declarations, corpus_mix::operators,
+                                             corpus_mix::identifiers,  corpus_mix::nesting,
+                                             corpus_mix::whitespace,   corpus_mix::tables,
+                                             corpus_mix::mixed};
+  return mixes;
+}
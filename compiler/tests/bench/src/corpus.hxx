@@ -0,0 +1,40 @@
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// the kinds of synthetic source the generator writes
+enum class corpus_mix : std::uint8_t {
+  declarations,  // blocks of short declarations: u8 v = 42
+  operators,     // operator dense expression lines, only for the lexer
+  identifiers,   // declarations with long names
+  nesting,       // deeply nested blocks
+  whitespace,    // declarations padded with blank lines, tabs and runs of spaces
+  tables,        // long runs of declarations with values over the whole range of their types
+  mixed,         // all of the parseable ones, interleaved
+};
+
+struct corpus_options {
+  corpus_mix mix = corpus_mix::mixed;
+  std::size_t bytes = 1 << 20;  // approximate, the text ends at a block boundary after this
+  std::uint32_t seed = 1;
+};
+
+// Deterministic: the same options give the same text on every platform and standard library.
+std::string generate_corpus(corpus_options const& options);
+
+// can parser_block parse the mix? (the root scope only knows the '=' operator)
+bool corpus_parseable(corpus_mix mix) noexcept;
+
+// the operators the operators mix uses, for the lexer's lookup
+std::vector<std::string_view> const& corpus_operators();
+
+std::string_view corpus_mix_name(corpus_mix mix) noexcept;
+
+// false for unknown names
+bool parse_corpus_mix(std::string_view name, corpus_mix& mix) noexcept;
+
+std::vector<corpus_mix> const& all_corpus_mixes();
@@ -0,0 +1,368 @@
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "corpus.hxx"
+#include "parser.hxx"
+
+// Front-end throughput on synthetic corpora: MB/s, tokens/s, allocations and peak RSS of lexing
+// (tokenizer::next_token) and parsing (parser_block), as a table or as tab separated values that can be stored
+// and compared against later with --baseline. --edit-latency measures incremental re-lexing against file size.
+
+namespace {
+std::atomic<std::size_t> allocations{0};
+std::atomic<std::size_t> allocated_bytes{0};
+}  // namespace
+
+// counts every allocation of the process, noinline: gcc can't pair the malloc and free of inlined replacements
+[[gnu::noinline]] void* operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+struct bench_options {
+  std::size_t bytes = 8 << 20;
+  std::uint32_t seed = 1;
+  int iterations = 5;
+  std::vector<corpus_mix> mixes = all_corpus_mixes();
+  bool tsv = false;
+  std::string baseline;
+  double tolerance = 10;  // percent of throughput lost before --baseline fails
+  std::string corpus_dir;
+  bool edit_latency = false;
+};
+
+struct measurement {
+  std::string mix;
+  std::string phase;
+  double mb_per_s = 0;
+  double tokens_per_s = 0;
+  std::size_t allocations = 0;
+  std::size_t allocated_bytes = 0;
+  long peak_rss_kb = 0;
+};
+
+// Peak RSS since the last reset. Linux can reset the high water mark through clear_refs, elsewhere this is the
+// peak of the whole process.
+void reset_peak_rss() { std::ofstream("/proc/self/clear_refs") << "5"; }
+
+long peak_rss_kb() {
+  std::ifstream status("/proc/self/status");
+  for (std::string line; std::getline(status, line);) {
+    if (line.rfind("VmHWM:", 0) == 0) {
+      return std::strtol(line.c_str() + 6, nullptr, 10);
+    }
+  }
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// the best of the iterations, allocations and memory of the last one
+template <typename Setup, typename Run>
+measurement measure(bench_options const& options, std::size_t bytes, Setup setup, Run run) {
+  double best = 0;
+  std::size_t tokens = 0;
+  measurement m;
+  for (int i = 0; i < options.iterations; ++i) {
+    auto state = setup();
+    reset_peak_rss();
+    const auto allocs = allocations.load();
+    const auto alloc_bytes = allocated_bytes.load();
+    const auto start = clock_type::now();
+    tokens = run(state);
+    const auto seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    if (i == 0 || seconds < best) {
+      best = seconds;
+    }
+    m.allocations = allocations.load() - allocs;
+    m.allocated_bytes = allocated_bytes.load() - alloc_bytes;
+    m.peak_rss_kb = peak_rss_kb();
+  }
+  m.mb_per_s = best > 0 ? static_cast<double>(bytes) / 1e6 / best : 0;
+  m.tokens_per_s = best > 0 ? static_cast<double>(tokens) / best : 0;
+  return m;
+}
+
+parser_context& lexer_scope() {
+  static parser_context pc;
+  static const bool declared = [] {
+    for (auto op : corpus_operators()) {
+      pc.declare_operator(op);
+    }
+    return true;
+  }();
+  static_cast<void>(declared);
+  return pc;
+}
+
+struct lexer_state {
+  diagnostic_reporter diagnostics;
+  std::unique_ptr<tokenizer> t;
+};
+
+lexer_state make_lexer(std::string const& text) {
+  lexer_state s;
+  s.t = std::make_unique<tokenizer>("<bench>", text, s.diagnostics);
+  s.t->bind_operator_scanner({tokenizer::scan_t::bind<&parser_context::operator_scan>(lexer_scope())});
+  return s;
+}
+
+std::size_t lex_all(tokenizer& t) {
+  while (t.next_token().type != token_type::eof) {
+  }
+  return t.tokens().size();
+}
+
+// top level blocks over the tokens lexed already, like the driver's parse phase
+std::size_t parse_all(tokenizer& t) {
+  t.seek(0);
+  ast_arena arena;
+  for (;;) {
+    t.skip_whitespace();
+    const auto tok = t.next_token();
+    if (tok.type == token_type::eof) {
+      return t.tokens().size();
+    }
+    if (tok.text != "{" || !parser_block::parse(t, arena)) {
+      std::fprintf(stderr, "corpus doesn't parse at token %zu\n", t.cursor());
+      std::exit(3);
+    }
+  }
+}
+
+std::vector<measurement> run_mix(bench_options const& options, corpus_mix mix) {
+  const auto text = generate_corpus({mix, options.bytes, options.seed});
+  if (!options.corpus_dir.empty()) {
+    std::ofstream(options.corpus_dir + "/" + std::string(corpus_mix_name(mix)) + ".mm") << text;
+  }
+
+  // a corpus with lexical errors would measure the error path, not the mix
+  {
+    auto s = make_lexer(text);
+    lex_all(*s.t);
+    if (s.diagnostics.error_count() != 0) {
+      std::fprintf(stderr, "corpus %s has %zu lexical errors\n", std::string(corpus_mix_name(mix)).c_str(),
+                   s.diagnostics.error_count());
+      std::exit(3);
+    }
+  }
+
+  std::vector<measurement> result;
+  result.push_back(measure(
+      options, text.size(), [&text] { return make_lexer(text); }, [](lexer_state& s) { return lex_all(*s.t); }));
+  result.back().phase = "lex";
+
+  if (corpus_parseable(mix)) {
+    result.push_back(measure(
+        options, text.size(),
+        [&text] {
+          auto s = make_lexer(text);
+          lex_all(*s.t);
+          return s;
+        },
+        [](lexer_state& s) { return parse_all(*s.t); }));
+    result.back().phase = "parse";
+  }
+
+  for (auto& m : result) {
+    m.mix = corpus_mix_name(mix);
+  }
+  return result;
+}
+
+// Edit latency against file size: the declarations corpus at growing sizes, lexed once, then one token edits
+// (tokenizer::apply_edit) spread over the middle of the file, the best of the iterations. Edits that change the
+// length are timed on owned text, which moves the rest of the file, and on borrowed text edited outside the timer.
+void run_edit_latency(bench_options const& options) {
+  using micros = std::chrono::duration<double, std::micro>;
+  constexpr int edits = 100;
+  const auto timed = [](auto&& edit) {
+    const auto start = clock_type::now();
+    edit();
+    return micros(clock_type::now() - start).count();
+  };
+  std::printf("%8s %10s %14s %14s %14s %14s\n", "MB", "Mtok", "first edit us", "same size us", "new token us",
+              "borrowed us");
+  for (std::size_t mb = 1; mb <= 64; mb *= 4) {
+    const auto text = generate_corpus({corpus_mix::declarations, mb << 20, options.seed});
+    std::vector<double> best(4, 0);
+    std::size_t tokens = 0;
+    for (int i = 0; i < options.iterations; ++i) {
+      auto owned = make_lexer(text);
+      tokens = lex_all(*owned.t);
+      auto borrowed = make_lexer(text);
+      lex_all(*borrowed.t);
+      std::string edited = text;
+      edited.reserve(text.size() + 4 * edits);
+
+      // the first edit moves the gaps from the end of the file to the middle and widens them
+      auto offset = static_cast<std::uint32_t>(text.find(" = ", text.size() / 2) + 3);
+      std::vector<double> us(4, 0);
+      us[0] = timed([&] { owned.t->apply_edit({offset, 0, "1 "}); });
+      edited.insert(offset, "1 ");
+      borrowed.t->apply_edit({offset, 0, "1 "}, edited);
+      for (int e = 0; e < edits; ++e) {
+        offset = static_cast<std::uint32_t>(edited.find(" = ", offset + 64) + 3);
+        us[1] += timed([&] { owned.t->apply_edit({offset, 1, "7"}); }) / edits;
+        us[2] += timed([&] { owned.t->apply_edit({offset, 0, "1 "}); }) / edits;
+        edited[offset] = '7';
+        borrowed.t->apply_edit({offset, 1, "7"}, edited);
+        edited.insert(offset, "1 ");
+        us[3] += timed([&] { borrowed.t->apply_edit({offset, 0, "1 "}, edited); }) / edits;
+      }
+      for (std::size_t k = 0; k < best.size(); ++k) {
+        best[k] = i == 0 ? us[k] : std::min(best[k], us[k]);
+      }
+    }
+    std::printf("%8zu %10.2f %14.0f %14.1f %14.1f %14.1f\n", mb, static_cast<double>(tokens) / 1e6, best[0],
+                best[1], best[2], best[3]);
+  }
+}
+
+void print_table(std::vector<measurement> const& results) {
+  std::printf("%-13s %-6s %10s %12s %12s %12s %12s\n", "mix", "phase", "MB/s", "Mtok/s", "allocs", "alloc MB",
+              "peak RSS MB");
+  for (auto const& m : results) {
+    std::printf("%-13s %-6s %10.1f %12.2f %12zu %12.1f %12.1f\n", m.mix.c_str(), m.phase.c_str(), m.mb_per_s,
+                m.tokens_per_s / 1e6, m.allocations, static_cast<double>(m.allocated_bytes) / 1e6,
+                static_cast<double>(m.peak_rss_kb) / 1e3);
+  }
+}
+
+void print_tsv(std::vector<measurement> const& results) {
+  std::printf("mix\tphase\tmb_per_s\ttokens_per_s\tallocations\tallocated_bytes\tpeak_rss_kb\n");
+  for (auto const& m : results) {
+    std::printf("%s\t%s\t%.3f\t%.0f\t%zu\t%zu\t%ld\n", m.mix.c_str(), m.phase.c_str(), m.mb_per_s, m.tokens_per_s,
+                m.allocations, m.allocated_bytes, m.peak_rss_kb);
+  }
+}
+
+// compares throughput with a stored --tsv output, false if any phase got slower than the tolerance
+bool compare_baseline(bench_options const& options, std::vector<measurement> const& results) {
+  std::ifstream in(options.baseline);
+  if (!in) {
+    std::fprintf(stderr, "can't read the baseline %s\n", options.baseline.c_str());
+    return false;
+  }
+  std::map<std::pair<std::string, std::string>, double> baseline;
+  std::string line;
+  std::getline(in, line);  // header
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string mix, phase;
+    double mb_per_s = 0;
+    if (std::getline(fields, mix, '\t') && std::getline(fields, phase, '\t') && fields >> mb_per_s) {
+      baseline[{mix, phase}] = mb_per_s;
+    }
+  }
+
+  bool ok = true;
+  std::fprintf(stderr, "compared to %s:\n", options.baseline.c_str());
+  for (auto const& m : results) {
+    const auto it = baseline.find({m.mix, m.phase});
+    if (it == baseline.end() || it->second <= 0) {
+      continue;
+    }
+    const double change = (m.mb_per_s / it->second - 1) * 100;
+    const bool regressed = change < -options.tolerance;
+    ok = ok && !regressed;
+    std::fprintf(stderr, "  %-13s %-6s %+7.1f%%%s\n", m.mix.c_str(), m.phase.c_str(), change,
+                 regressed ? "  REGRESSION" : "");
+  }
+  return ok;
+}
+
+bool parse_options(int argc, char** argv, bench_options& options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--tsv") {
+      options.tsv = true;
+    } else if (arg == "--size" && has_value) {
+      options.bytes = static_cast<std::size_t>(std::strtod(argv[++i], nullptr) * (1 << 20));
+    } else if (arg == "--seed" && has_value) {
+      options.seed = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--iterations" && has_value) {
+      options.iterations = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--mix" && has_value) {
+      corpus_mix mix{};
+      if (!parse_corpus_mix(argv[++i], mix)) {
+        return false;
+      }
+      options.mixes = {mix};
+    } else if (arg == "--baseline" && has_value) {
+      options.baseline = argv[++i];
+    } else if (arg == "--tolerance" && has_value) {
+      options.tolerance = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--write-corpus" && has_value) {
+      options.corpus_dir = argv[++i];
+    } else if (arg == "--edit-latency") {
+      options.edit_latency = true;
+    } else {
+      return false;
+    }
+  }
+  return options.bytes != 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench_options options;
+  if (!parse_options(argc, argv, options)) {
+    std::string mixes;  // from the list, so a new mix shows up here
+    for (auto mix : all_corpus_mixes()) {
+      mixes += (mixes.empty() ? "" : "|") + std::string(corpus_mix_name(mix));
+    }
+    std::fprintf(stderr,
+                 "usage: %s [--size MB] [--mix %s]\n"
+                 "          [--seed N] [--iterations N] [--tsv] [--baseline file.tsv [--tolerance percent]]\n"
+                 "          [--write-corpus dir] [--edit-latency]\n",
+                 argv[0], mixes.c_str());
+    return 2;
+  }
+  if (options.edit_latency) {
+    run_edit_latency(options);
+    return 0;
+  }
+
+  std::vector<measurement> results;
+  for (auto mix : options.mixes) {
+    for (auto& m : run_mix(options, mix)) {
+      results.push_back(std::move(m));
+    }
+  }
+
+  if (options.tsv) {
+    print_tsv(results);
+  } else {
+    print_table(results);
+  }
+  if (!options.baseline.empty() && !compare_baseline(options, results)) {
+    return 1;
+  }
+  return 0;
+}
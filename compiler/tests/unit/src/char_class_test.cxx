@@ -0,0 +1,121 @@
+
+#include "char_class.hxx"
+
+#include <charconv>
+#include <random>
+#include <string>
+
+#include "catch.hpp"
+
+namespace {
+const char* scan_reference(const char* begin, const char* end, std::uint8_t classes) {
+  while (begin != end && has_class(*begin, classes)) {
+    ++begin;
+  }
+  return begin;
+}
+}  // namespace
+
+TEST_CASE("The character class table matches the token grammar", "[char_class]") {
+  REQUIRE(has_class(' ', cc_whitespace));
+  REQUIRE(has_class('\r', cc_whitespace));
+  REQUIRE(has_class('7', cc_digit));
+  REQUIRE(has_class('7', cc_identifier));
+  REQUIRE(!has_class('7', cc_identifier_start));
+  REQUIRE(has_class('_', cc_identifier_start));
+  REQUIRE(has_class('Z', cc_identifier_start));
+  REQUIRE(has_class(':', cc_operator));
+  REQUIRE(has_class('}', cc_bracket));
+  REQUIRE(has_class(';', cc_semicolon));
+  REQUIRE(!has_class('.', cc_operator | cc_identifier | cc_whitespace | cc_bracket | cc_semicolon));
+  REQUIRE(!has_class(static_cast<char>(0xe1), cc_identifier_start));
+}
+
+TEST_CASE("Every scan kernel stops at the same character as the scalar loop", "[char_class]") {
+  for (auto const* kernels : available_scan_kernels()) {
+    for (int stop = 0; stop < 256; ++stop) {
+      for (std::size_t run : {0, 1, 15, 16, 17, 31, 32, 33, 70}) {
+        const std::string whitespace = std::string(run, run % 2 ? '\n' : ' ') + static_cast<char>(stop) + "  ";
+        const std::string identifier = std::string(run, run % 2 ? 'Q' : '9') + static_cast<char>(stop) + "aa";
+        const std::string digits = std::string(run, '5') + static_cast<char>(stop) + "11";
+
+        const char* b = whitespace.data();
+        REQUIRE(kernels->whitespace(b, b + whitespace.size()) == scan_reference(b, b + whitespace.size(), cc_whitespace));
+        b = identifier.data();
+        REQUIRE(kernels->identifier(b, b + identifier.size()) == scan_reference(b, b + identifier.size(), cc_identifier));
+        b = digits.data();
+        REQUIRE(kernels->digits(b, b + digits.size()) == scan_reference(b, b + digits.size(), cc_digit));
+
+        // never reads past the end
+        b = identifier.data();
+        REQUIRE(kernels->identifier(b, b + run) == b + run);
+      }
+    }
+  }
+}
+
+TEST_CASE("Every line start kernel finds the same newlines", "[char_class]") {
+  std::string text;
+  for (int i = 0; i < 300; ++i) {
+    text += std::string(static_cast<std::size_t>(i % 37), 'x') + (i % 5 ? "\n" : "\r\n\n");
+  }
+  std::vector<std::uint32_t> expected;
+  for (std::uint32_t i = 0; i < text.size(); ++i) {
+    if (text[i] == '\n') {
+      expected.push_back(i + 1);
+    }
+  }
+  for (auto const* kernels : available_scan_kernels()) {
+    for (std::size_t skip : {0, 1, 7, 31}) {
+      std::vector<std::uint32_t> starts;
+      kernels->line_starts(text.data() + skip, text.data() + text.size(), starts);
+      std::vector<std::uint32_t> shifted;
+      for (auto e : expected) {
+        if (e > skip) {
+          shifted.push_back(static_cast<std::uint32_t>(e - skip));
+        }
+      }
+      REQUIRE(starts == shifted);
+    }
+  }
+}
+
+TEST_CASE("Digits decode to the value from_chars finds", "[char_class]") {
+  const auto decode = [](std::string const& digits, std::uint64_t& value) {
+    return decode_digits(digits.data(), digits.data() + digits.size(), value);
+  };
+  const auto reference = [](std::string const& digits, std::uint64_t& value) {
+    return std::from_chars(digits.data(), digits.data() + digits.size(), value).ec == std::errc{};
+  };
+
+  std::vector<std::string> cases{"0",
+                                 "7",
+                                 "12345678",
+                                 "123456789",
+                                 "9999999999999999999",
+                                 "10000000000000000000",
+                                 "18446744073709551615",
+                                 "18446744073709551616",
+                                 "99999999999999999999",
+                                 "100000000000000000000",
+                                 "000000000000000000000000018446744073709551615",
+                                 "00000000000000000000000000"};
+  std::mt19937 rng(99);
+  for (int i = 0; i < 10000; ++i) {
+    std::string digits;
+    for (auto n = 1 + rng() % 22; n != 0; --n) {
+      digits += static_cast<char>('0' + rng() % 10);
+    }
+    cases.push_back(digits);
+  }
+
+  for (auto const& digits : cases) {
+    std::uint64_t value = 0;
+    std::uint64_t expected = 0;
+    const bool ok = reference(digits, expected);
+    REQUIRE(decode(digits, value) == ok);
+    if (ok) {
+      REQUIRE(value == expected);
+    }
+  }
+}
@@ -0,0 +1,231 @@
+
+#include "driver.hxx"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+#include "catch.hpp"
+
+namespace {
+// stdin reads text from a pipe while it lives, the text has to fit into the pipe's buffer
+class stdin_source {
+ public:
+  explicit stdin_source(std::string_view text) : saved_(::dup(0)) {
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    REQUIRE(::write(fds[1], text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+    ::close(fds[1]);
+    ::dup2(fds[0], 0);
+    ::close(fds[0]);
+  }
+  ~stdin_source() {
+    ::dup2(saved_, 0);
+    ::close(saved_);
+  }
+
+ private:
+  int saved_;
+};
+}  // namespace
+
+TEST_CASE("Driver options accept job counts and files", "[driver]") {
+  driver_options options;
+  std::string error;
+  char const* args[] = {"compiler", "-j", "3", "a.mm", "b.mm"};
+  REQUIRE(parse_driver_options(5, args, options, error));
+  REQUIRE(options.jobs == 3);
+  REQUIRE(options.files == std::vector<std::string>{"a.mm", "b.mm"});
+
+  driver_options packed;
+  char const* packed_args[] = {"compiler", "-j12", "a.mm"};
+  REQUIRE(parse_driver_options(3, packed_args, packed, error));
+  REQUIRE(packed.jobs == 12);
+
+  driver_options pipelined;
+  char const* pipelined_args[] = {"compiler", "--pipeline", "a.mm"};
+  REQUIRE(parse_driver_options(3, pipelined_args, pipelined, error));
+  REQUIRE(pipelined.pipeline);
+
+  driver_options invalid;
+  char const* invalid_args[] = {"compiler", "-j", "0", "a.mm"};
+  REQUIRE(!parse_driver_options(4, invalid_args, invalid, error));
+
+  driver_options empty;
+  char const* empty_args[] = {"compiler", "-j2"};
+  REQUIRE(!parse_driver_options(2, empty_args, empty, error));
+}
+
+TEST_CASE("Job counts are bounded", "[driver]") {
+  const auto limit = std::to_string(max_driver_jobs());
+  const auto over = std::to_string(max_driver_jobs() + 1);
+  std::string error;
+
+  driver_options largest;
+  char const* largest_args[] = {"compiler", "-j", limit.c_str(), "a.mm"};
+  REQUIRE(parse_driver_options(4, largest_args, largest, error));
+  REQUIRE(largest.jobs == max_driver_jobs());
+  REQUIRE(max_driver_jobs() >= 64);
+
+  driver_options too_many;
+  char const* too_many_args[] = {"compiler", "-j", over.c_str(), "a.mm"};
+  REQUIRE(!parse_driver_options(4, too_many_args, too_many, error));
+  REQUIRE(error == "job count over " + limit + ": " + over);
+
+  // 2^64 + 3 would wrap around to 3
+  driver_options wrapping;
+  char const* wrapping_args[] = {"compiler", "-j18446744073709551619", "a.mm"};
+  REQUIRE(!parse_driver_options(3, wrapping_args, wrapping, error));
+  REQUIRE(wrapping.jobs == 0);
+}
+
+TEST_CASE("The driver reports results in file order", "[driver]") {
+  std::ofstream("driver_good.mm") << "{ u8 a = 1\n { s16 b = -2; }\n}\n{ u64 c = 3; }\n";
+  std::ofstream("driver_bad.mm") << "{ u8 a = b }";
+
+  driver_options options;
+  options.jobs = 2;
+  options.files = {"driver_good.mm", "driver_missing.mm", "driver_bad.mm", "driver_good.mm"};
+  const auto result = run_driver(options);
+
+  REQUIRE(result.files.size() == 4);
+  REQUIRE(result.files[0].parsed);
+  REQUIRE(result.files[0].diagnostics.messages().empty());
+  REQUIRE(result.files[0].tokens > 20);
+  REQUIRE(!result.files[1].parsed);
+  REQUIRE(result.files[1].diagnostics.messages().size() == 1);
+  REQUIRE(!result.files[2].parsed);
+  REQUIRE(result.files[2].diagnostics.messages().size() == 1);
+  REQUIRE(result.files[3].parsed);
+  REQUIRE(result.has_errors());
+
+  options.pipeline = true;
+  const auto pipelined = run_driver(options);
+  for (std::size_t i = 0; i < 4; ++i) {
+    REQUIRE(pipelined.files[i].parsed == result.files[i].parsed);
+    REQUIRE(pipelined.files[i].diagnostics.messages().size() == result.files[i].diagnostics.messages().size());
+  }
+  REQUIRE(pipelined.files[0].tokens == result.files[0].tokens);
+
+  std::remove("driver_good.mm");
+  std::remove("driver_bad.mm");
+}
+
+TEST_CASE("Files over 4 GiB are reported as too large", "[driver]") {
+  std::ofstream("driver_large.mm").close();
+  std::filesystem::resize_file("driver_large.mm", std::uint64_t{1} << 32);
+
+  driver_options options;
+  options.files = {"driver_large.mm"};
+  const auto result = run_driver(options);
+  REQUIRE(!result.files[0].parsed);
+  REQUIRE(result.files[0].diagnostics.messages().size() == 1);
+  REQUIRE(result.files[0].diagnostics.messages()[0].diag.diagnostic_code() == 103);
+
+  std::remove("driver_large.mm");
+}
+
+TEST_CASE("Clean files are reused from the cache", "[driver]") {
+  std::ofstream("driver_cached.mm") << "{ u8 a = 1\n { s16 b = -2; }\n}\n";
+  std::ofstream("driver_uncached.mm") << "{ u8 a = b }";
+
+  driver_options options;
+  options.files = {"driver_cached.mm", "driver_uncached.mm"};
+  options.cache_dir = "driver_cache";
+  const auto first = run_driver(options);
+  const auto second = run_driver(options);
+
+  REQUIRE(!first.files[0].cached);
+  REQUIRE(second.files[0].cached);
+  REQUIRE(second.files[0].parsed);
+  REQUIRE(second.files[0].tokens == first.files[0].tokens);
+  REQUIRE(!second.files[1].cached);
+  REQUIRE(second.files[1].diagnostics.messages().size() == 1);
+
+  std::ofstream("driver_cached.mm", std::ios::app) << "{ u8 c = 3; }\n";
+  REQUIRE(!run_driver(options).files[0].cached);
+
+  std::remove("driver_cached.mm");
+  std::remove("driver_uncached.mm");
+  std::filesystem::remove_all("driver_cache");
+}
+
+TEST_CASE("A large file is lexed in parts with the results of one job", "[driver]") {
+  {
+    std::ofstream out("driver_large.mm");
+    for (int i = 0; i < 100000; ++i) {
+      out << "{ u8 a" << i << " = 1\n { s16 b = -2; }\n}\n";
+    }
+    out << "{ u8 c = 3. }\n";
+  }
+
+  driver_options options;
+  options.files = {"driver_large.mm"};
+  options.jobs = 1;
+  const auto one = run_driver(options);
+  options.jobs = 4;
+  const auto four = run_driver(options);
+
+  REQUIRE(one.files[0].bytes > (2u << 20));
+  REQUIRE(four.files[0].tokens == one.files[0].tokens);
+  REQUIRE(four.files[0].parsed == one.files[0].parsed);
+  REQUIRE(four.files[0].diagnostics.error_count() == one.files[0].diagnostics.error_count());
+  REQUIRE(four.files[0].diagnostics.messages().size() == one.files[0].diagnostics.messages().size());
+
+  std::remove("driver_large.mm");
+}
+
+TEST_CASE("Invalid blocks on stdin are reported at their text", "[driver]") {
+  driver_options options;
+  options.files = {"-"};
+  for (std::string_view text : {"{ u8 a = 1\n", "{ u9 a = 1 }", "{ u8 a = b }", "{ u8 a = 1 }\n}"}) {
+    stdin_source source(text);
+    const auto result = run_driver(options);
+    REQUIRE(!result.files[0].parsed);
+    REQUIRE(result.files[0].diagnostics.messages().size() == 1);
+  }
+}
+
+TEST_CASE("Invalid files are reported at their text when pipelined", "[driver]") {
+  std::ofstream("driver_unterminated.mm") << "{ u8 a = 1";
+  std::ofstream("driver_unknown.mm") << "{ u8 a = 1 }\n{ u9 b = 2 }";
+  std::ofstream("driver_closing.mm") << "{ u8 a = 1 }\n}";
+
+  driver_options options;
+  options.files = {"driver_unterminated.mm", "driver_unknown.mm", "driver_closing.mm"};
+  const auto result = run_driver(options);
+  options.pipeline = true;
+  const auto pipelined = run_driver(options);
+  for (std::size_t i = 0; i < options.files.size(); ++i) {
+    REQUIRE(!result.files[i].parsed);
+    REQUIRE(!pipelined.files[i].parsed);
+    REQUIRE(result.files[i].diagnostics.messages().size() == 1);
+    REQUIRE(pipelined.files[i].diagnostics.messages().size() == 1);
+    const auto at = result.files[i].diagnostics.messages()[0].where.start;
+    const auto pipelined_at = pipelined.files[i].diagnostics.messages()[0].where.start;
+    REQUIRE(pipelined_at.line == at.line);
+    REQUIRE(pipelined_at.offset == at.offset);
+  }
+
+  std::remove("driver_unterminated.mm");
+  std::remove("driver_unknown.mm");
+  std::remove("driver_closing.mm");
+}
+
+TEST_CASE("Lexical errors are counted once with and without a pipeline", "[driver]") {
+  std::ofstream("driver_lexical.mm") << "{ u8 a. = 1 }\n{ u64 b = 18446744073709551616 }\n{ u8 c = 1";
+
+  driver_options options;
+  options.files = {"driver_lexical.mm"};
+  const auto result = run_driver(options);
+  options.pipeline = true;
+  const auto pipelined = run_driver(options);
+  auto const& diagnostics = result.files[0].diagnostics;
+  REQUIRE(pipelined.files[0].diagnostics.error_count() == diagnostics.error_count());
+  REQUIRE(pipelined.files[0].diagnostics.messages().size() == diagnostics.messages().size());
+  REQUIRE(diagnostics.error_count() == diagnostics.messages().size());
+
+  std::remove("driver_lexical.mm");
+}
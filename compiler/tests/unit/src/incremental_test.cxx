@@ -0,0 +1,232 @@
+#include "incremental.hxx"
+
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "parser.hxx"
+
+namespace {
+
+parser_context& operators() {
+  static parser_context pc;
+  static const bool declared = [] {
+    for (auto name : {"==", "+", "+=", "-", "->", "<<=", "<"}) {
+      pc.declare_operator(name);
+    }
+    return true;
+  }();
+  static_cast<void>(declared);
+  return pc;
+}
+
+void bind(tokenizer& t) {
+  t.bind_operator_lookup(tokenizer::lookup_t::bind<&parser_context::operator_or_prefix>(operators()));
+}
+
+// up to the end, or an operator that can't make progress
+void lex_all(tokenizer& t) {
+  for (auto tok = t.next_token(); tok.type != token_type::eof && !tok.text.empty(); tok = t.next_token()) {
+  }
+}
+
+using token_tuple = std::tuple<token_type, std::uint32_t, std::uint32_t, bool, symbol_id, std::uint64_t, bool>;
+
+// a stalled lexer repeats its empty token when asked again, only the first one counts
+std::vector<token_tuple> all_tokens(token_buffer const& tokens) {
+  std::vector<token_tuple> result;
+  for (std::size_t i = 0; i < tokens.size(); ++i) {
+    const auto numeric = tokens.kind(i) == token_type::numeric;
+    result.emplace_back(tokens.kind(i), tokens.start(i), tokens.length(i), tokens.error(i),
+                        numeric ? no_symbol : tokens.symbol(i), tokens.value(i), tokens.negative(i));
+    if (tokens.length(i) == 0) {
+      break;
+    }
+  }
+  return result;
+}
+
+std::vector<token_tuple> full_lex(std::string const& text) {
+  diagnostic_reporter rep;
+  tokenizer t("<full>", text, rep);
+  bind(t);
+  lex_all(t);
+  return all_tokens(t.tokens());
+}
+
+std::size_t full_lex_memory(std::string const& text) {
+  diagnostic_reporter rep;
+  tokenizer t("<full>", text, rep);
+  bind(t);
+  lex_all(t);
+  return t.tokens().memory_usage();
+}
+
+std::string random_text(std::mt19937& rng, std::size_t length) {
+  static const std::vector<std::string> pieces{"a", "b1", "_x", "42", "-7", " ", "\n", "  ", ";", "{", "}",
+                                               "=",  "==", "+",  "<<=", "->", "f+", "9z", "?", "u8"};
+  std::string result;
+  while (result.size() < length) {
+    result += pieces[rng() % pieces.size()];
+  }
+  return result;
+}
+
+// the shape of a tree: kind, tokens, and the child count of blocks
+using node_tuple = std::tuple<ast_kind, std::uint32_t, std::uint32_t, std::uint32_t, std::uint32_t>;
+
+std::vector<node_tuple> shape(ast_arena const& arena, ast_index root) {
+  std::vector<node_tuple> result;
+  arena.walk(root, [&](ast_index, ast_node const& n) {
+    const auto count = n.kind == ast_kind::block ? n.rhs : n.lhs;
+    result.emplace_back(n.kind, n.first_token, n.last_token, count, n.kind == ast_kind::block ? 0 : n.rhs);
+  });
+  return result;
+}
+
+std::vector<node_tuple> full_parse(std::string const& text) {
+  diagnostic_reporter rep;
+  tokenizer t("<full>", text, rep);
+  t.next_token();
+  ast_arena arena;
+  return shape(arena, *parser_block::parse(t, arena));
+}
+
+}  // namespace
+
+#include "catch.hpp"
+
+TEST_CASE("Stored tokens are replayed after a seek", "[incremental]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "a = 42;", rep);
+  bind(t);
+  lex_all(t);
+  t.seek(2);
+  REQUIRE(t.cursor() == 2);
+  REQUIRE(t.next_token().text == "=");
+  REQUIRE(t.skip_whitespace());
+  REQUIRE(t.next_token().text == "42");
+  REQUIRE(!t.skip_whitespace());
+  REQUIRE(t.next_token().type == token_type::semicolon);
+  REQUIRE(t.next_token().type == token_type::eof);
+  REQUIRE(t.tokens().size() == 7);
+}
+
+TEST_CASE("An edit only re-lexes the tokens around it", "[incremental]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "a = 42; b = 7; c = 9;", rep);
+  bind(t);
+  lex_all(t);
+  const auto size = t.tokens().size();
+
+  const auto e = t.apply_edit({4, 2, "1234"});
+  REQUIRE(t.content() == "a = 1234; b = 7; c = 9;");
+  REQUIRE(e.first == 3);  // the whitespace before the number ends at the edit
+  REQUIRE(e.removed == 2);
+  REQUIRE(e.inserted == 2);
+  REQUIRE(t.tokens().size() == size);
+  REQUIRE(t.token_at(4).text == "1234");
+  REQUIRE(t.token_at(7).text == "b");
+  REQUIRE(all_tokens(t.tokens()) == full_lex(std::string(t.content())));
+}
+
+TEST_CASE("Random edits re-lex to the same tokens as a full lex", "[incremental]") {
+  std::mt19937 rng(1234);
+  for (int round = 0; round < 500; ++round) {
+    diagnostic_reporter rep;
+    tokenizer t("<test>", random_text(rng, 1 + rng() % 60), rep);
+    bind(t);
+
+    // sometimes only a part is lexed when the edit comes
+    if (rng() % 3 == 0) {
+      for (auto lexed = rng() % 10; lexed != 0 && !t.next_token().text.empty(); --lexed) {
+      }
+    } else {
+      lex_all(t);
+    }
+
+    t.position(0);  // the line table is built, and patched by the edits from now on
+    for (int edit = 0; edit < 4; ++edit) {
+      const auto size = static_cast<std::uint32_t>(t.content().size());
+      const auto offset = static_cast<std::uint32_t>(rng() % (size + 1));
+      const auto length = static_cast<std::uint32_t>(rng() % (size - offset + 1) % 8);
+      const auto replacement = random_text(rng, rng() % 6);
+      t.apply_edit({offset, length, replacement});
+    }
+
+    lex_all(t);
+    INFO(t.content());
+    REQUIRE(all_tokens(t.tokens()) == full_lex(std::string(t.content())));
+    const line_index lines(t.content());
+    for (std::uint32_t i = 0; i <= t.content().size(); ++i) {
+      REQUIRE(t.position(i).line == lines.position(i).line);
+      REQUIRE(t.position(i).offset == lines.position(i).offset);
+    }
+  }
+}
+
+TEST_CASE("Numeric values are kept through many edits", "[incremental]") {
+  std::string text;
+  for (int i = 0; i < 200; ++i) {
+    text += "a = " + std::to_string(1000 + i) + ";\n";
+  }
+  diagnostic_reporter rep;
+  tokenizer t("<test>", text, rep);
+  bind(t);
+  lex_all(t);
+
+  // each edit replaces a number, the values of the old ones pile up until the table is compacted
+  std::mt19937 rng(99);
+  for (int edit = 0; edit < 2000; ++edit) {
+    const auto line = rng() % 200;
+    const auto offset = static_cast<std::uint32_t>(line * 10 + 4);
+    t.apply_edit({offset, 4, std::to_string(1000 + rng() % 9000)});
+  }
+  lex_all(t);
+  REQUIRE(all_tokens(t.tokens()) == full_lex(std::string(t.content())));
+  REQUIRE(t.tokens().memory_usage() < 2 * full_lex_memory(std::string(t.content())));
+}
+
+TEST_CASE("An edit inside a nested block reparses only that block", "[incremental]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "{ u8 a = 1\n { u16 b = 2; } u32 c = 3; }", rep);
+  bind(t);
+  t.next_token();
+  ast_arena arena;
+  const auto root = *parser_block::parse(t, arena);
+  const auto nodes = arena.size();
+
+  const auto e = t.apply_edit({22, 1, "200; s8 d = -4"});
+  REQUIRE(reparse_after_edit(t, arena, root, e) == root);
+  REQUIRE(arena.size() == nodes + 3);  // the block and its two declarations
+  REQUIRE(shape(arena, root) == full_parse(std::string(t.content())));
+}
+
+TEST_CASE("A changed bracket reparses the enclosing block", "[incremental]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "{ u8 a = 1\n { u16 b = 2; } u32 c = 3; }", rep);
+  bind(t);
+  t.next_token();
+  ast_arena arena;
+  const auto old_root = *parser_block::parse(t, arena);
+
+  const auto e = t.apply_edit({24, 0, " } {"});
+  const auto root = reparse_after_edit(t, arena, old_root, e);
+  REQUIRE(root != no_node);
+  REQUIRE(root != old_root);
+  REQUIRE(arena.children(root).size() == 4);
+  REQUIRE(shape(arena, root) == full_parse(std::string(t.content())));
+}
+
+TEST_CASE("An edit that breaks the top level block needs a full parse", "[incremental]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "{ u8 a = 1\n { u16 b = 2; } }", rep);
+  bind(t);
+  t.next_token();
+  ast_arena arena;
+  const auto root = *parser_block::parse(t, arena);
+
+  const auto e = t.apply_edit({25, 1, ""});  // the closing bracket of the inner block
+  REQUIRE(reparse_after_edit(t, arena, root, e) == no_node);
+}
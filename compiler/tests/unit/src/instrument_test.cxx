@@ -0,0 +1,99 @@
+
+#include "instrument.hxx"
+
+#include <sstream>
+#include <thread>
+
+#include <spdlog/logger.h>
+#include <spdlog/sinks/ostream_sink.h>
+
+#include "parser.hxx"
+
+#include "catch.hpp"
+
+namespace {
+const auto token_always_exist = [](std::string_view) { return true; };
+}  // namespace
+
+TEST_CASE("Tokens and rollbacks are counted on the bound track", "[instrument]") {
+  trace_recorder recorder;
+  diagnostic_reporter rep;
+  {
+    trace_binding binding(&recorder, "<test>");
+    phase_timer timer("lex");
+    tokenizer t("<test>", "a 42a b", rep);
+    t.next_token(token_always_exist);
+    {
+      tokenizer::checkpointer c{t};
+      t.next_token(token_always_exist);
+      t.next_token(token_always_exist);
+    }
+  }
+
+  const auto totals = recorder.totals();
+  if constexpr (trace_recorder::enabled) {
+    REQUIRE(totals[token_type::identifier] == 1);
+    REQUIRE(totals[token_type::whitespace] == 1);
+    REQUIRE(totals[token_type::numeric] == 1);
+    REQUIRE(totals[counter::rollbacks] == 1);
+    REQUIRE(totals[counter::discarded_tokens] == 2);
+    REQUIRE(totals[counter::diagnostics] == rep.error_count());
+    REQUIRE(recorder.tracks().size() == 1);
+    REQUIRE(recorder.tracks()[0].events.size() == 1);
+  } else {
+    REQUIRE(totals[token_type::identifier] == 0);
+    REQUIRE(totals[counter::rollbacks] == 0);
+    REQUIRE(recorder.tracks()[0].events.empty());
+  }
+}
+
+TEST_CASE("Nothing is counted without a binding", "[instrument]") {
+  trace_recorder recorder;
+  {
+    trace_binding outer(&recorder, "outer");
+    { trace_binding none(nullptr, "none"); }
+    count_event(counter::operator_lookups);
+  }
+  count_event(counter::operator_lookups);
+  REQUIRE(current_track() == nullptr);
+  REQUIRE(recorder.totals()[counter::operator_lookups] == (trace_recorder::enabled ? 1 : 0));
+}
+
+TEST_CASE("Every thread records its own track", "[instrument]") {
+  trace_recorder recorder;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&recorder, i] {
+      trace_binding binding(&recorder, "file " + std::to_string(i));
+      for (int j = 0; j < 1000; ++j) {
+        count_event(counter::operator_lookups);
+      }
+    });
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+  REQUIRE(recorder.tracks().size() == 4);
+  REQUIRE(recorder.totals()[counter::operator_lookups] == (trace_recorder::enabled ? 4000 : 0));
+}
+
+TEST_CASE("The trace is Chrome trace_event JSON", "[instrument]") {
+  trace_recorder recorder;
+  {
+    trace_binding binding(&recorder, "dir/\"quoted\".mm");
+    phase_timer timer("parse");
+  }
+  std::ostringstream out;
+  recorder.write_chrome_trace(out);
+  const auto json = out.str();
+  REQUIRE(json.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0) == 0);
+  REQUIRE(json.find("\"name\":\"dir/\\\"quoted\\\".mm\",\"cat\":\"track\",\"ph\":\"X\"") != std::string::npos);
+  REQUIRE(json.find("\"tokens.identifier\":0") != std::string::npos);
+  REQUIRE((json.find("\"name\":\"parse\",\"cat\":\"phase\"") != std::string::npos) == trace_recorder::enabled);
+
+  std::ostringstream summary;
+  spdlog::logger log("test", std::make_shared<spdlog::sinks::ostream_sink_st>(summary));
+  log.set_pattern("%v");
+  recorder.log_summary(log);
+  REQUIRE(summary.str().rfind("instrumentation: 1 tracks\n", 0) == 0);
+}
@@ -0,0 +1,130 @@
+
+#include "operator_trie.hxx"
+
+#include <random>
+#include <set>
+#include <string>
+
+#include "parser.hxx"
+
+#include "catch.hpp"
+
+namespace {
+
+// the lookup the trie replaces: a sorted set, and a prefix query per character
+struct reference_operators {
+  std::set<std::string, std::less<>> names;
+
+  bool operator()(std::string_view text) const {
+    auto it = names.lower_bound(text);
+    return it != names.end() && it->substr(0, text.size()) == text;
+  }
+};
+
+constexpr std::array<std::string_view, 4> test_operators{"<<=", "<", "->", ":not:"};
+constexpr auto test_table =
+    make_operator_table<operator_table_states(test_operators), operator_table_width(test_operators)>(test_operators);
+
+static_assert(test_table.count == 4);
+static_assert(builtin_operator_table.count == builtin_operators.size());
+
+}  // namespace
+
+TEST_CASE("The trie knows every prefix of its operators", "[operator_trie]") {
+  operator_trie trie;
+  REQUIRE(trie.empty());
+  REQUIRE(!trie.prefix(""));
+  REQUIRE(!trie.prefix("="));
+
+  trie.insert("==");
+  REQUIRE(trie.prefix(""));
+  REQUIRE(trie.prefix("="));
+  REQUIRE(trie.prefix("=="));
+  REQUIRE(!trie.prefix("==="));
+  REQUIRE(!trie.prefix("<"));
+
+  trie.insert("<=>");  // new characters widen the table
+  trie.insert("=~");
+  REQUIRE(trie.prefix("=="));
+  REQUIRE(trie.prefix("<="));
+  REQUIRE(trie.prefix("<=>"));
+  REQUIRE(trie.prefix("=~"));
+  REQUIRE(!trie.prefix("<>"));
+  REQUIRE(!trie.prefix("~"));
+}
+
+TEST_CASE("A compile time table matches the inserted trie", "[operator_trie]") {
+  const operator_trie built(test_table);
+  operator_trie inserted;
+  reference_operators reference;
+  for (auto op : test_operators) {
+    inserted.insert(op);
+    reference.names.emplace(op);
+  }
+  for (std::string text : {"", "<", "<<", "<<=", "<<==", "<=", "-", "->", "->>", ":", ":no", ":not:", ":nop", "x"}) {
+    INFO(text);
+    REQUIRE(built.prefix(text) == reference(text));
+    REQUIRE(inserted.prefix(text) == reference(text));
+  }
+}
+
+TEST_CASE("The scan over nested scopes munches like the prefix queries", "[operator_trie]") {
+  const std::string alphabet = "=<>-+:!?ab1_ ;";
+  std::mt19937 rng(77);
+  for (int round = 0; round < 300; ++round) {
+    parser_context root;
+    parser_context middle{root};
+    parser_context inner{middle};
+    reference_operators reference{{"="}};
+    for (auto* pc : {&root, &middle, &inner}) {
+      for (auto n = rng() % 4; n != 0; --n) {
+        std::string op;
+        for (auto length = 1 + rng() % 4; length != 0; --length) {
+          op += alphabet[rng() % 7];
+        }
+        if (rng() % 3 == 0) {
+          op += "ab";
+        }
+        pc->declare_operator(op);
+        reference.names.insert(op);
+      }
+    }
+
+    std::string text;
+    for (auto length = rng() % 12; length != 0; --length) {
+      text += alphabet[rng() % alphabet.size()];
+    }
+    std::size_t length = 0;
+    const auto expected = scan_operator(text, [&](char) { return reference(text.substr(0, ++length)); });
+    INFO(text);
+    REQUIRE(inner.operator_scan(text) == expected);
+    for (std::size_t i = 0; i <= text.size(); ++i) {
+      REQUIRE(inner.operator_or_prefix(std::string_view(text).substr(0, i)) == reference(text.substr(0, i)));
+    }
+  }
+}
+
+TEST_CASE("A bound scanner lexes like the bound lookup", "[operator_trie]") {
+  parser_context pc;
+  for (auto op : {"==", "+", "+=", "-", "->", "<<=", "<", ":not:"}) {
+    pc.declare_operator(op);
+  }
+  const std::string text = "a == b+=-4; c->d <<= e :not: f ==+ g <<< h :no i -> -7 +x";
+
+  diagnostic_reporter rep;
+  tokenizer by_lookup("<test>", text, rep);
+  by_lookup.bind_operator_lookup(tokenizer::lookup_t::bind<&parser_context::operator_or_prefix>(pc));
+  tokenizer by_scan("<test>", text, rep);
+  by_scan.bind_operator_scanner({tokenizer::scan_t::bind<&parser_context::operator_scan>(pc)});
+
+  for (;;) {
+    const auto expected = by_lookup.next_token();
+    const auto tok = by_scan.next_token();
+    REQUIRE(tok.type == expected.type);
+    REQUIRE(tok.text == expected.text);
+    REQUIRE(tok.error == expected.error);
+    if (tok.type == token_type::eof || tok.text.empty()) {
+      break;
+    }
+  }
+}
@@ -0,0 +1,179 @@
+
+#include "parse_cache.hxx"
+
+#include <filesystem>
+#include <fstream>
+
+#include "hash.hxx"
+#include "parser.hxx"
+
+#include "catch.hpp"
+
+namespace {
+
+struct parsed_text {
+  diagnostic_reporter rep;
+  tokenizer t;
+  ast_arena arena;
+  std::vector<ast_index> roots;
+
+  explicit parsed_text(std::string text) : t("<test>", std::move(text), rep) {
+    while (t.skip_whitespace(), t.next_token().type != token_type::eof) {
+      roots.push_back(*parser_block::parse(t, arena));
+    }
+  }
+};
+
+// a fresh directory, removed at the end of the test
+struct temporary_directory {
+  std::string path = (std::filesystem::temp_directory_path() / "metamorf_cache_test").string();
+  temporary_directory() { std::filesystem::remove_all(path); }
+  ~temporary_directory() { std::filesystem::remove_all(path); }
+};
+
+}  // namespace
+
+TEST_CASE("The content hash is XXH64", "[parse_cache]") {
+  REQUIRE(hash_bytes("") == 0xEF46DB3751D8E999ull);
+  REQUIRE(hash_bytes("a") == 0xD24EC4F1A98C6E5Bull);
+  REQUIRE(hash_bytes("abc") == 0x44BC2CF5AD770999ull);
+  REQUIRE(hash_bytes("Nobody inspects the spammish repetition") == 0xFBCEA83C8A378BF1ull);
+}
+
+TEST_CASE("A stored unit is found with its tokens and tree", "[parse_cache]") {
+  temporary_directory dir;
+  parse_cache cache(dir.path);
+  const std::string text = "{ u8 a = 1\n { s16 b = -2; }\n}\n{ u64 c = 3; }\n";
+  parsed_text p(text);
+  parser_context pc;
+  const auto key = parse_cache::key(text, pc);
+
+  REQUIRE(!cache.find(key, text.size()));
+  REQUIRE(cache.store(key, text.size(), p.t.tokens(), p.arena, p.roots));
+  const auto unit = cache.find(key, text.size());
+  REQUIRE(unit);
+  REQUIRE(!cache.find(key, text.size() + 1));
+
+  auto const& tokens = p.t.tokens();
+  REQUIRE(unit->token_count() == tokens.size());
+  for (std::size_t i = 0; i < tokens.size(); ++i) {
+    REQUIRE(unit->kind(i) == tokens.kind(i));
+    REQUIRE(unit->start(i) == tokens.start(i));
+    REQUIRE(unit->length(i) == tokens.length(i));
+    REQUIRE(unit->error(i) == tokens.error(i));
+    REQUIRE(unit->value(i) == tokens.value(i));
+    REQUIRE(unit->negative(i) == tokens.negative(i));
+  }
+  REQUIRE(unit->node_count() == p.arena.size());
+  REQUIRE(unit->roots().size() == 2);
+  p.arena.walk(p.roots[0], [&](ast_index i, ast_node const& n) {
+    REQUIRE(unit->node(i).kind == n.kind);
+    REQUIRE(unit->node(i).first_token == n.first_token);
+    REQUIRE(unit->node(i).last_token == n.last_token);
+    REQUIRE(unit->children(i).size() == p.arena.children(i).size());
+  });
+}
+
+TEST_CASE("An edited token buffer is stored in order", "[parse_cache]") {
+  temporary_directory dir;
+  parse_cache cache(dir.path);
+  parsed_text p("{ u8 a = 1\n { s16 b = -2; }\n}\n{ u64 c = 3; }\n");
+  p.t.apply_edit({9, 1, "12 "});
+  REQUIRE(p.t.tokens().gap() < p.t.tokens().size());
+
+  const std::string text(p.t.content());
+  parsed_text fresh(text);
+  parser_context pc;
+  const auto key = parse_cache::key(text, pc);
+  REQUIRE(cache.store(key, text.size(), p.t.tokens(), fresh.arena, fresh.roots));
+  const auto unit = cache.find(key, text.size());
+  REQUIRE(unit);
+  auto const& tokens = fresh.t.tokens();
+  REQUIRE(unit->token_count() == tokens.size());
+  for (std::size_t i = 0; i < tokens.size(); ++i) {
+    REQUIRE(unit->kind(i) == tokens.kind(i));
+    REQUIRE(unit->start(i) == tokens.start(i));
+    REQUIRE(unit->length(i) == tokens.length(i));
+    REQUIRE(unit->value(i) == tokens.value(i));
+    REQUIRE(unit->negative(i) == tokens.negative(i));
+  }
+}
+
+TEST_CASE("The key depends on the text and the parser configuration", "[parse_cache]") {
+  parser_context pc;
+  const auto key = parse_cache::key("{ u8 a = 1; }", pc);
+  REQUIRE(parse_cache::key("{ u8 a = 1; }", pc) == key);
+  REQUIRE(parse_cache::key("{ u8 a = 2; }", pc) != key);
+
+  parser_context other;
+  other.declare_operator("+");
+  REQUIRE(parse_cache::key("{ u8 a = 1; }", other) != key);
+
+  parser_context typed;
+  typed.declare_type(string_interner::global().intern("f32"));
+  REQUIRE(parse_cache::key("{ u8 a = 1; }", typed) != key);
+}
+
+TEST_CASE("A damaged entry is a miss", "[parse_cache]") {
+  temporary_directory dir;
+  parse_cache cache(dir.path);
+  const std::string text = "{ u8 a = 1; }";
+  parsed_text p(text);
+  const auto key = parse_cache::key(text, parser_context{});
+  REQUIRE(cache.store(key, text.size(), p.t.tokens(), p.arena, p.roots));
+
+  std::filesystem::resize_file(cache.path(key), std::filesystem::file_size(cache.path(key)) - 1);
+  REQUIRE(!cache.find(key, text.size()));
+
+  std::ofstream(cache.path(key), std::ios::binary) << "not a cache entry, but long enough for the header of one ....";
+  REQUIRE(!cache.find(key, text.size()));
+}
+
+TEST_CASE("An entry with a changed byte fails its checksum", "[parse_cache]") {
+  temporary_directory dir;
+  parse_cache cache(dir.path);
+  const std::string text = "{ u8 a = 1; { s8 b = -2; } }";
+  parsed_text p(text);
+  const auto key = parse_cache::key(text, parser_context{});
+  REQUIRE(cache.store(key, text.size(), p.t.tokens(), p.arena, p.roots));
+  REQUIRE(cache.find(key, text.size()));
+
+  const auto size = std::filesystem::file_size(cache.path(key));
+  for (const auto at : {std::uintmax_t{40}, size / 2, size - 1}) {
+    std::string entry(size, '\0');
+    std::ifstream(cache.path(key), std::ios::binary).read(entry.data(), static_cast<std::streamsize>(size));
+    entry[at] = static_cast<char>(entry[at] ^ 0x10);
+    std::ofstream(cache.path(key), std::ios::binary | std::ios::trunc) << entry;
+    REQUIRE(!cache.find(key, text.size()));
+    entry[at] = static_cast<char>(entry[at] ^ 0x10);
+    std::ofstream(cache.path(key), std::ios::binary | std::ios::trunc) << entry;
+    REQUIRE(cache.find(key, text.size()));
+  }
+}
+
+TEST_CASE("An entry with indices out of bounds is a miss", "[parse_cache]") {
+  temporary_directory dir;
+  parse_cache cache(dir.path);
+  const std::string text = "{ u8 a = 1; { s8 b = -2; } }";
+  parsed_text p(text);
+  const auto key = parse_cache::key(text, parser_context{});
+
+  // the store writes what it is given, with a valid checksum
+  const auto stored = [&](auto&& damage, std::vector<ast_index> roots) {
+    ast_arena arena = p.arena;
+    damage(arena);
+    REQUIRE(cache.store(key, text.size(), p.t.tokens(), arena, roots));
+    return cache.find(key, text.size()).has_value();
+  };
+  const auto block = p.roots[0];
+  REQUIRE(stored([](ast_arena&) {}, p.roots));
+  REQUIRE(!stored([](ast_arena&) {}, {static_cast<ast_index>(p.arena.size())}));
+  REQUIRE(!stored([&](ast_arena& a) { a[block].rhs = static_cast<std::uint32_t>(a.child_array().size()) + 1; },
+                  p.roots));
+  REQUIRE(!stored([&](ast_arena& a) { a[block].lhs = ~std::uint32_t{0}; }, p.roots));
+  REQUIRE(!stored([&](ast_arena& a) { a[block].last_token = 1000; }, p.roots));
+  REQUIRE(!stored([&](ast_arena& a) { a[a.children(block).b[0]].lhs = 1000; }, p.roots));
+  // a child that is its own parent: walking the roots would never end
+  REQUIRE(!stored([&](ast_arena& a) { a.replace_child(block, a.children(block).b[0], block); }, p.roots));
+  REQUIRE(!stored([](ast_arena&) {}, {block, block}));
+}
@@ -1,6 +1,8 @@
 
 #include "parser.hxx"
 
+#include <tuple>
+
 namespace {
 const auto token_always_exist = [](std::string_view) { return true; };
 }
@@ -11,19 +13,199 @@ TEST_CASE("A variable declaration can be parsed, ending with a newilne", "[parse
   diagnostic_reporter rep;
   tokenizer t("<test>", "{ u8 v = 42\n }", rep);
   t.next_token(token_always_exist);  // skip the first bracket, parser_block expect it to be parsed
-  parser_block p{t};
+  ast_arena arena;
+  REQUIRE(parser_block::parse(t, arena));
 }
 
 TEST_CASE("A variable declaration can be parsed, ending with a semicolon", "[parser]") {
   diagnostic_reporter rep;
   tokenizer t("<test>", "{ u8 v = 2; }", rep);
   t.next_token(token_always_exist);  // skip the first bracket, parser_block expect it to be parsed
-  parser_block p{t};
+  ast_arena arena;
+  REQUIRE(parser_block::parse(t, arena));
 }
 
 TEST_CASE("Two variable declarations can be parsed", "[parser]") {
   diagnostic_reporter rep;
-  tokenizer t("<test>", "{ u8 a = 42; u16 b = -5\n }", rep);
+  tokenizer t("<test>", "{ u8 a = 42; s16 b = -5\n }", rep);
+  t.next_token(token_always_exist);  // skip the first bracket, parser_block expect it to be parsed
+  ast_arena arena;
+  REQUIRE(parser_block::parse(t, arena));
+}
+
+TEST_CASE("Declared values have to fit the integer type", "[parser]") {
+  const std::vector<std::tuple<std::string, std::string, bool>> cases{
+      {"u8", "255", true},
+      {"u8", "256", false},
+      {"u8", "-1", false},
+      {"u8", "-0", true},
+      {"s8", "127", true},
+      {"s8", "128", false},
+      {"s8", "-128", true},
+      {"s8", "-129", false},
+      {"u16", "65535", true},
+      {"s16", "-32769", false},
+      {"u32", "4294967296", false},
+      {"s32", "-2147483648", true},
+      {"u64", "18446744073709551615", true},
+      {"s64", "9223372036854775807", true},
+      {"s64", "9223372036854775808", false},
+      {"s64", "-9223372036854775808", true},
+  };
+  for (auto const& [type, value, fits] : cases) {
+    diagnostic_reporter rep;
+    tokenizer t("<test>", "{ " + type + " v = " + value + "; }", rep);
+    t.next_token(token_always_exist);  // skip the first bracket, parser_block expect it to be parsed
+    ast_arena arena;
+    const auto p = parser_block::parse(t, arena);
+    REQUIRE(static_cast<bool>(p) == fits);
+    if (!fits) {
+      REQUIRE(p.error().code == parse_errc::value_out_of_range);
+      REQUIRE(t.content().substr(p.error().start, p.error().length) == value);
+    }
+  }
+
+  // an overflowing literal fits no type, it is a lexical error
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "{ u64 v = 18446744073709551616; }", rep);
+  t.next_token(token_always_exist);
+  ast_arena arena;
+  const auto p = parser_block::parse(t, arena);
+  REQUIRE(!p);
+  REQUIRE(p.error().code == parse_errc::invalid_token);
+}
+
+TEST_CASE("Nested blocks see the names of the enclosing scope", "[parser]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "{ u8 a = 1\n { s16 b = 2; } u32 c = 3; }", rep);
+  t.next_token(token_always_exist);  // skip the first bracket, parser_block expect it to be parsed
+  ast_arena arena;
+  REQUIRE(parser_block::parse(t, arena));
+  REQUIRE(t.next_token(token_always_exist).type == token_type::eof);
+}
+
+TEST_CASE("An unterminated block is an error", "[parser]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "{ u8 a = 1\n", rep);
+  t.next_token(token_always_exist);  // skip the first bracket, parser_block expect it to be parsed
+  ast_arena arena;
+  const auto p = parser_block::parse(t, arena);
+  REQUIRE(!p);
+  REQUIRE(p.error().code == parse_errc::unterminated_block);
+  REQUIRE(p.error().start == t.content().size());  // the eof, its token was rolled back
+  REQUIRE(p.error().length == 0);
+  REQUIRE(arena.size() == 0);
+}
+
+TEST_CASE("Scopes resolve names through their parents", "[parser]") {
+  auto& si = string_interner::global();
+  parser_context root;
+  parser_context inner{root};
+  inner.declare_variable(si.intern("x"));
+  REQUIRE(inner.type_exists(si.intern("u8")));
+  REQUIRE(inner.type_exists("s64"));
+  REQUIRE(!inner.type_exists("v8"));
+  REQUIRE(inner.variable_exists(si.intern("x")));
+  REQUIRE(!root.variable_exists(si.intern("x")));
+  REQUIRE(inner.operator_exists(si.intern("=")));
+  REQUIRE(inner.operator_or_prefix("="));
+}
+
+TEST_CASE("Blocks and declarations are stored in the arena", "[parser]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "{ u8 a = 1\n { s16 b = 2; } u32 c = 3; }", rep);
+  t.next_token(token_always_exist);  // skip the first bracket, parser_block expect it to be parsed
+  ast_arena arena;
+  const auto p = parser_block::parse(t, arena);
+  REQUIRE(p);
+
+  auto const& root = arena[*p];
+  REQUIRE(root.kind == ast_kind::block);
+  REQUIRE(t.token_at(root.first_token).text == "{");
+  REQUIRE(root.last_token == t.tokens().size() - 1);
+
+  const auto stmts = arena.children(*p);
+  REQUIRE(stmts.size() == 3);
+  REQUIRE(arena[stmts.begin()[0]].kind == ast_kind::decl_stmt);
+  REQUIRE(t.token_at(arena[stmts.begin()[0]].lhs).text == "a");
+  REQUIRE(t.token_at(arena[stmts.begin()[0]].rhs).text == "1");
+  REQUIRE(arena[stmts.begin()[1]].kind == ast_kind::block);
+  REQUIRE(t.token_at(arena[stmts.begin()[2]].first_token).text == "u32");
+
+  std::vector<ast_kind> order;
+  arena.walk(*p, [&order](ast_index, ast_node const& n) { order.push_back(n.kind); });
+  REQUIRE(order == std::vector<ast_kind>{ast_kind::block, ast_kind::decl_stmt, ast_kind::block, ast_kind::decl_stmt,
+                                         ast_kind::decl_stmt});
+}
+
+TEST_CASE("A failed parse rolls the arena back", "[parser]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "{ u8 a = 1\n { s16 b = 2; } u32 c = x; }", rep);
+  t.next_token(token_always_exist);  // skip the first bracket, parser_block expect it to be parsed
+  ast_arena arena;
+  arena.add({ast_kind::block, 0, 0, 0, 0});
+  const auto p = parser_block::parse(t, arena);
+  REQUIRE(!p);
+  REQUIRE(p.error().code == parse_errc::wrong_token);
+  REQUIRE(t.content().substr(p.error().start, p.error().length) == "x");
+  REQUIRE(arena.size() == 1);
+  REQUIRE(t.tokens().size() == 1);
+}
+
+TEST_CASE("A memoized parse reuses the outcome of a rule at a token", "[parser]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "{ u8 a = 1\n { s16 b = 2; } u32 c = x; }", rep);
   t.next_token(token_always_exist);  // skip the first bracket, parser_block expect it to be parsed
-  parser_block p{t};
+  ast_arena arena;
+  parse_memo memo;
+
+  const auto failed = parser_block::parse(t, arena, &memo);
+  REQUIRE(!failed);
+  REQUIRE(t.cursor() == 1);
+  const auto nodes = arena.size();
+  REQUIRE(nodes == 4);  // kept for the memo: both blocks and the two declarations
+
+  const auto again = parser_block::parse(t, arena, &memo);
+  REQUIRE(!again);
+  REQUIRE(again.error().token == failed.error().token);
+  REQUIRE(arena.size() == nodes);
+
+  // the nested block succeeded on its own, and is found without parsing it again
+  REQUIRE(memo.find(parse_rule::block, 11) != nullptr);
+  t.seek(11);
+  const auto nested = parser_block::parse(t, arena, &memo);
+  REQUIRE(nested);
+  REQUIRE(arena.size() == nodes);
+  REQUIRE(t.token_at(arena[*nested].last_token).text == "}");
+  REQUIRE(t.cursor() == arena[*nested].last_token + 1);
+}
+
+TEST_CASE("A pipelined tokenizer parses to the same tree", "[parser]") {
+  std::string text = "{ u8 a = 1\n { s16 b = 2; } u32 c = 3; ";
+  for (int i = 0; i < 2000; ++i) {
+    text += "{ u64 v" + std::to_string(i) + " = " + std::to_string(i) + "\n }\n";
+  }
+  text += "}";
+
+  const auto parse = [&text](bool pipelined, std::vector<ast_kind>& kinds) {
+    diagnostic_reporter rep;
+    parser_context root;
+    tokenizer t("<test>", text, rep);
+    t.bind_operator_scanner({tokenizer::scan_t::bind<&parser_context::operator_scan>(root)});
+    if (pipelined) {
+      t.start_pipeline(64);
+    }
+    t.next_token();  // skip the first bracket, parser_block expect it to be parsed
+    ast_arena arena;
+    const auto p = parser_block::parse(t, arena);
+    REQUIRE(p);
+    arena.walk(*p, [&kinds](ast_index, ast_node const& n) { kinds.push_back(n.kind); });
+    REQUIRE(t.next_token().type == token_type::eof);
+    return t.tokens().size();
+  };
+  std::vector<ast_kind> expected;
+  std::vector<ast_kind> kinds;
+  REQUIRE(parse(true, kinds) == parse(false, expected));
+  REQUIRE(kinds == expected);
+  REQUIRE(kinds.size() > 4000);
 }
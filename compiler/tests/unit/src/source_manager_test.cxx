@@ -0,0 +1,86 @@
+
+#include "source_manager.hxx"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+#include "tokenizer.hxx"
+
+#include "catch.hpp"
+
+TEST_CASE("A caller owned buffer is borrowed, not copied", "[source_manager]") {
+  const std::string text = "u8 v = 42";
+  source_manager sm;
+  const auto id = sm.add_buffer("<test>", text);
+  REQUIRE(sm.content(id).data() == text.data());
+  REQUIRE(sm.name(id) == "<test>");
+}
+
+TEST_CASE("Views stay stable while files are added", "[source_manager]") {
+  source_manager sm;
+  const auto first = sm.add_owned_buffer("<first>", "ab");
+  const auto view = sm.content(first);
+  for (int i = 0; i < 100; ++i) {
+    sm.add_owned_buffer("<more>", "cd");
+  }
+  REQUIRE(sm.content(first).data() == view.data());
+  REQUIRE(sm.content(first) == "ab");
+  REQUIRE(sm.file_count() == 101);
+}
+
+TEST_CASE("Files are loaded from disk", "[source_manager]") {
+  const std::string path = "source_manager_test.mm";
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << "{ u8 v = 42\n }";
+  }
+  {
+    source_manager sm;
+    const auto id = sm.load_file(path);
+    REQUIRE(sm.content(id) == "{ u8 v = 42\n }");
+
+    diagnostic_reporter rep;
+    tokenizer t(sm, id, rep);
+    REQUIRE(t.next_token().text == "{");
+    REQUIRE(t.content().data() == sm.content(id).data());
+  }
+  std::remove(path.c_str());
+
+  source_manager sm;
+  REQUIRE_THROWS_AS(sm.load_file(path), std::system_error);
+}
+
+TEST_CASE("Empty files can be loaded", "[source_manager]") {
+  const std::string path = "source_manager_empty.mm";
+  std::ofstream(path, std::ios::binary).close();
+  {
+    source_manager sm;
+    const auto id = sm.load_file(path);
+    REQUIRE(sm.content(id).empty());
+
+    diagnostic_reporter rep;
+    tokenizer t(sm, id, rep);
+    REQUIRE(t.next_token().type == token_type::eof);
+  }
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Files too large for 32 bit offsets are rejected", "[source_manager]") {
+  // sparse, nothing is written or mapped
+  const std::string path = "source_manager_large.mm";
+  std::ofstream(path, std::ios::binary).close();
+  std::filesystem::resize_file(path, source_manager::max_file_size + 1);
+  {
+    source_manager sm;
+    try {
+      sm.load_file(path);
+      FAIL("a file over 4 GiB was loaded");
+    } catch (std::system_error const& e) {
+      REQUIRE(e.code() == std::errc::file_too_large);
+    }
+    REQUIRE(sm.file_count() == 0);
+  }
+  std::remove(path.c_str());
+}
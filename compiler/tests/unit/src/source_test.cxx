@@ -0,0 +1,133 @@
+
+#include "source.hxx"
+
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spdlog/logger.h>
+#include <spdlog/sinks/ostream_sink.h>
+
+#include "catch.hpp"
+
+namespace {
+
+class test_error_t : public diagnostic_message {
+  diagnostic_level level() const override { return diagnostic_level::error; }
+  std::string message() const override { return "Test error."; }
+  int diagnostic_code() const override { return 7; }
+};
+
+class test_warning_t : public diagnostic_message {
+  diagnostic_level level() const override { return diagnostic_level::warning; }
+  std::string message() const override { return "Test warning."; }
+  int diagnostic_code() const override { return 8; }
+};
+
+test_error_t test_error;
+test_warning_t test_warning;
+
+source_range at(int line, int offset) { return {{line, offset}, {line, offset + 1}}; }
+
+}  // namespace
+
+TEST_CASE("Diagnostics over the caps are only counted", "[source]") {
+  diagnostic_reporter rep({3, 2});
+  int located = 0;
+  for (int i = 0; i < 5; ++i) {
+    rep.report(test_error, [&located, i] {
+      ++located;
+      return at(1, i);
+    });
+  }
+  rep.report({test_warning, at(2, 0), ""});
+  rep.report({test_warning, at(2, 1), ""});
+  rep.report({test_warning, at(2, 2), ""});
+
+  REQUIRE(located == 2);  // the locations of dropped diagnostics are never computed
+  REQUIRE(rep.messages().size() == 4);
+  REQUIRE(rep.error_count() == 5);
+  REQUIRE(rep.suppressed() == 4);
+}
+
+TEST_CASE("Diagnostics are merged in location order without duplicates", "[source]") {
+  diagnostic_reporter rep;
+  rep.report({test_error, at(3, 1), ""});
+  rep.report({test_warning, at(1, 4), "try this"});
+  rep.report({test_error, at(3, 1), ""});
+
+  const auto messages = rep.messages();
+  REQUIRE(messages.size() == 2);
+  REQUIRE(messages[0].where.start.line == 1);
+  REQUIRE(messages[0].suggestion == "try this");
+  REQUIRE(messages[1].diag.diagnostic_code() == 7);
+}
+
+TEST_CASE("Diagnostics can be reported from many threads", "[source]") {
+  diagnostic_reporter rep({100000, 100000});
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&rep, t] {
+      for (int i = 0; i < 1000; ++i) {
+        rep.report({test_error, at(i, t), ""});
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  const auto messages = rep.messages();
+  REQUIRE(messages.size() == 4000);
+  REQUIRE(messages.front().where.start.line == 0);
+  REQUIRE(messages.back().where.start.line == 999);
+  REQUIRE(rep.error_count() == 4000);
+}
+
+TEST_CASE("Diagnostics are rendered through a logger", "[source]") {
+  diagnostic_reporter rep({1, 10});
+  rep.report({test_error, at(2, 5), "a suggestion"});
+  rep.report({test_error, at(3, 1), ""});
+
+  std::ostringstream out;
+  spdlog::logger log("test", std::make_shared<spdlog::sinks::ostream_sink_mt>(out));
+  log.set_pattern("%v");
+  rep.render(log, "file.mm");
+
+  REQUIRE(out.str() ==
+          "file.mm:2:5: error: Test error. [7]\n"
+          "file.mm:2:5: note: a suggestion\n"
+          "file.mm: 1 more diagnostics suppressed\n");
+}
+
+TEST_CASE("Line positions are patched through edits", "[source]") {
+  std::mt19937 rng(99);
+  const auto random_text = [&rng](std::size_t length) {
+    std::string text;
+    while (text.size() < length) {
+      text += "ab\n \n\nc"[rng() % 8];
+    }
+    return text;
+  };
+  for (int round = 0; round < 200; ++round) {
+    auto text = random_text(rng() % 40);
+    line_index lines(text);
+    for (int edit = 0; edit < 8; ++edit) {
+      const auto offset = static_cast<std::uint32_t>(rng() % (text.size() + 1));
+      const auto length = static_cast<std::uint32_t>(rng() % (text.size() - offset + 1) % 6);
+      const auto replacement = random_text(rng() % 5);
+      text.replace(offset, length, replacement);
+      lines.apply_edit(offset, length, replacement);
+
+      const line_index fresh(text);
+      REQUIRE(lines.line_count() == fresh.line_count());
+      for (std::uint32_t i = 0; i <= text.size(); ++i) {
+        INFO(text << " at " << i);
+        REQUIRE(lines.position(i).line == fresh.position(i).line);
+        REQUIRE(lines.position(i).offset == fresh.position(i).offset);
+      }
+    }
+  }
+}
@@ -0,0 +1,52 @@
+
+#include "spsc_queue.hxx"
+
+#include <cstdint>
+#include <thread>
+
+#include "catch.hpp"
+
+TEST_CASE("The queue is bounded by its capacity", "[spsc_queue]") {
+  spsc_queue<int> q(5);
+  REQUIRE(q.capacity() == 8);
+  int value = 0;
+  REQUIRE(!q.try_pop(value));
+  for (int i = 0; i < 8; ++i) {
+    REQUIRE(q.try_push(i));
+  }
+  REQUIRE(!q.try_push(8));
+  REQUIRE(q.try_pop(value));
+  REQUIRE(value == 0);
+  REQUIRE(q.try_push(8));
+  for (int i = 1; i <= 8; ++i) {
+    REQUIRE(q.try_pop(value));
+    REQUIRE(value == i);
+  }
+  REQUIRE(!q.try_pop(value));
+}
+
+TEST_CASE("Values cross threads in order", "[spsc_queue]") {
+  spsc_queue<std::uint64_t> q(64);
+  constexpr std::uint64_t count = 1000000;
+  std::thread producer([&q] {
+    for (std::uint64_t i = 0; i < count; ++i) {
+      while (!q.try_push(i)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  std::uint64_t out_of_order = 0;  // Catch assertions aren't thread safe, checked after the join
+  std::uint64_t expected = 0;
+  while (expected < count) {
+    std::uint64_t value = 0;
+    if (q.try_pop(value)) {
+      out_of_order += value != expected ? 1 : 0;
+      ++expected;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  REQUIRE(out_of_order == 0);
+}
@@ -0,0 +1,61 @@
+
+#include "symbol.hxx"
+
+#include <string>
+#include <thread>
+
+#include "catch.hpp"
+
+TEST_CASE("Equal spellings intern to the same symbol", "[symbol]") {
+  string_interner si;
+  const std::string a = "value";
+  const auto id = si.intern(a);
+  REQUIRE(id != no_symbol);
+  REQUIRE(si.intern(std::string("val") + "ue") == id);
+  REQUIRE(si.intern("other") != id);
+  REQUIRE(si.name(id) == "value");
+  REQUIRE(si.find("value") == id);
+  REQUIRE(si.find("missing") == no_symbol);
+}
+
+TEST_CASE("Interned names survive table growth", "[symbol]") {
+  string_interner si;
+  for (int i = 0; i < 5000; ++i) {
+    REQUIRE(si.intern("name_" + std::to_string(i)) == static_cast<symbol_id>(i + 1));
+  }
+  REQUIRE(si.size() == 5000);
+  REQUIRE(si.name(1234) == "name_1233");
+  REQUIRE(si.find("name_4999") == 5000);
+}
+
+TEST_CASE("Interning is thread safe", "[symbol]") {
+  string_interner si;
+  std::vector<symbol_id> seen[4];
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&si, &seen, t] {
+      for (int i = 0; i < 2000; ++i) {
+        seen[t].push_back(si.intern("n" + std::to_string(i)));
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  REQUIRE(si.size() == 2000);
+  REQUIRE(seen[0] == seen[1]);
+  REQUIRE(seen[0] == seen[3]);
+}
+
+TEST_CASE("A symbol map finds inserted ids only", "[symbol]") {
+  symbol_map<int> m;
+  REQUIRE(m.find(3) == nullptr);
+  for (symbol_id id = 1; id < 200; id += 2) {
+    REQUIRE(m.insert(id, static_cast<int>(id) * 10));
+  }
+  REQUIRE(!m.insert(3, 0));
+  REQUIRE(m.size() == 100);
+  REQUIRE(*m.find(3) == 30);
+  REQUIRE(*m.find(199) == 1990);
+  REQUIRE(m.find(4) == nullptr);
+}
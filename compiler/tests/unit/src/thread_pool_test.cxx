@@ -0,0 +1,61 @@
+
+#include "thread_pool.hxx"
+
+#include <atomic>
+
+#include "catch.hpp"
+
+TEST_CASE("Every submitted task runs before wait returns", "[thread_pool]") {
+  thread_pool pool(4);
+  REQUIRE(pool.size() == 4);
+  std::atomic<int> sum{0};
+  for (int i = 1; i <= 1000; ++i) {
+    pool.submit([&sum, i] { sum += i; });
+  }
+  pool.wait();
+  REQUIRE(sum == 500500);
+}
+
+TEST_CASE("Tasks can submit more tasks", "[thread_pool]") {
+  thread_pool pool(3);
+  std::atomic<int> leaves{0};
+  std::atomic<int> outside_pool{0};  // Catch assertions aren't thread safe, count in the tasks
+  for (int i = 0; i < 10; ++i) {
+    pool.submit([&pool, &leaves, &outside_pool] {
+      if (thread_pool::current_worker() >= pool.size()) {
+        ++outside_pool;
+      }
+      for (int j = 0; j < 10; ++j) {
+        pool.submit([&leaves] { ++leaves; });
+      }
+    });
+  }
+  pool.wait();
+  REQUIRE(leaves == 100);
+  REQUIRE(outside_pool == 0);
+  REQUIRE(thread_pool::current_worker() == thread_pool::npos);
+}
+
+TEST_CASE("Idle workers are woken for every round of work", "[thread_pool]") {
+  // the workers go to sleep between the rounds, a lost wake-up hangs wait
+  thread_pool pool(4);
+  std::atomic<int> done{0};
+  for (int round = 0; round < 2000; ++round) {
+    for (int i = 0; i < round % 5 + 1; ++i) {
+      pool.submit([&done] { ++done; });
+    }
+    pool.wait();
+  }
+  REQUIRE(done == 6000);
+}
+
+TEST_CASE("Queued tasks still run when the pool is destroyed", "[thread_pool]") {
+  std::atomic<int> done{0};
+  {
+    thread_pool pool(2);
+    for (int i = 0; i < 100; ++i) {
+      pool.submit([&done] { ++done; });
+    }
+  }
+  REQUIRE(done == 100);
+}
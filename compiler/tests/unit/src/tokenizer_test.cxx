@@ -1,18 +1,123 @@
 
 #include "tokenizer.hxx"
 
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include "thread_pool.hxx"
+
 #include "catch.hpp"
 
 namespace {
 const auto token_always_exist = [](std::string_view) { return true; };
 const auto token_never_exist = [](std::string_view) { return false; };
 const auto token_len_5 = [](std::string_view sv) { return sv.length() <= 5; };
+
+// the text comes through a pipe, written by another thread, it has to be read to the end
+class pipe_source {
+ public:
+  explicit pipe_source(std::string text) {
+    REQUIRE(::pipe(fds_) == 0);
+    writer_ = std::thread([fd = fds_[1], text = std::move(text)] {
+      for (std::size_t done = 0; done < text.size();) {
+        const auto n = ::write(fd, text.data() + done, text.size() - done);
+        if (n <= 0) {
+          break;
+        }
+        done += static_cast<std::size_t>(n);
+      }
+      ::close(fd);
+    });
+  }
+  ~pipe_source() {
+    writer_.join();
+    ::close(fds_[0]);
+  }
+
+  int fd() const noexcept { return fds_[0]; }
+
+ private:
+  int fds_[2];
+  std::thread writer_;
+};
+
+std::string mixed_text(int repeats) {
+  std::string text;
+  for (int i = 0; i < repeats; ++i) {
+    text += "int a" + std::to_string(i) + " = -" + std::to_string(i * 7) + ";\n  :op: b?  42a\t[x]. ::::::::: \n";
+  }
+  return text;
+}
+
+std::string random_text(std::mt19937& rng, std::size_t length) {
+  static const std::vector<std::string> pieces{"a",  "b1", "_x", "42", "-7", " ",  "\n", "  \n\t", ";", "{", "}",
+                                               "=",  ":op:", "f+", "9z", "?",  ".",  "&",     "\n\n", "[x]",
+                                               "18446744073709551616"};
+  std::string result;
+  while (result.size() < length) {
+    result += pieces[rng() % pieces.size()];
+  }
+  return result;
+}
+
+// lex_parallel against next_token until eof or a stalled operator: the same tokens and diagnostics
+template <typename F>
+void expect_parallel_lex(thread_pool& pool, std::string const& text, F&& lookup, std::size_t parts,
+                         diagnostic_limits limits = {}) {
+  diagnostic_reporter seq_rep(limits);
+  tokenizer seq("<test>", text, seq_rep);
+  seq.bind_operator_lookup(lookup);
+  for (;;) {
+    const auto tok = seq.next_token();
+    if (tok.type == token_type::eof || tok.text.empty()) {
+      break;
+    }
+  }
+
+  diagnostic_reporter par_rep(limits);
+  tokenizer par("<test>", text, par_rep);
+  par.bind_operator_lookup(lookup);
+  par.lex_parallel(pool, parts);
+
+  auto const& a = seq.tokens();
+  auto const& b = par.tokens();
+  REQUIRE(b.size() == a.size());
+  REQUIRE(par.cursor() == b.size());
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    REQUIRE(b.kind(i) == a.kind(i));
+    REQUIRE(b.start(i) == a.start(i));
+    REQUIRE(b.length(i) == a.length(i));
+    REQUIRE(b.error(i) == a.error(i));
+    REQUIRE(b.symbol(i) == a.symbol(i));
+    REQUIRE(b.value(i) == a.value(i));
+    REQUIRE(b.negative(i) == a.negative(i));
+  }
+
+  REQUIRE(par_rep.error_count() == seq_rep.error_count());
+  REQUIRE(par_rep.suppressed() == seq_rep.suppressed());
+  const auto expected = seq_rep.messages();
+  const auto messages = par_rep.messages();
+  REQUIRE(messages.size() == expected.size());
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    REQUIRE(&messages[i].diag == &expected[i].diag);
+    REQUIRE(messages[i].where.start.line == expected[i].where.start.line);
+    REQUIRE(messages[i].where.start.offset == expected[i].where.start.offset);
+    REQUIRE(messages[i].where.end.line == expected[i].where.end.line);
+    REQUIRE(messages[i].where.end.offset == expected[i].where.end.offset);
+  }
+}
 }  // namespace
 
 void single_token_test(std::string inp, std::string tokenized, token_type tt, bool success) {
   diagnostic_reporter rep;
   tokenizer t("<test>", inp, rep);
-  auto& tok = t.next_token(token_always_exist);
+  auto const& tok = t.next_token(token_always_exist);
   REQUIRE(tok.text == tokenized);
   REQUIRE(tok.type == tt);
   REQUIRE(!tok.error == success);
@@ -22,12 +127,12 @@ void single_token_test(std::string inp, std::string tokenized, token_type tt, bo
 void two_token_test(std::string inp, std::string p1, token_type tt1, std::string p2, token_type tt2, bool success) {
   diagnostic_reporter rep;
   tokenizer t("<test>", inp, rep);
-  auto& tok1 = t.next_token(token_always_exist);
+  auto const& tok1 = t.next_token(token_always_exist);
   REQUIRE(tok1.text == p1);
   REQUIRE(tok1.type == tt1);
   REQUIRE(!tok1.error == success);
 
-  auto& tok2 = t.next_token(token_always_exist);
+  auto const& tok2 = t.next_token(token_always_exist);
   REQUIRE(tok2.text == p2);
   REQUIRE(tok2.type == tt2);
 
@@ -41,7 +146,7 @@ TEST_CASE("An operator is tokenized", "[tokenizer]") { single_token_test(":not:"
 TEST_CASE("An operator requires some length", "[tokenizer]") {
   diagnostic_reporter rep;
   tokenizer t("<test>", "::::", rep);
-  auto& tok1 = t.next_token(token_never_exist);
+  auto const& tok1 = t.next_token(token_never_exist);
   REQUIRE(tok1.text == "");
   REQUIRE(tok1.type == token_type::oper);
   REQUIRE(tok1.error);
@@ -50,12 +155,12 @@ TEST_CASE("An operator requires some length", "[tokenizer]") {
 TEST_CASE("Two operator without inner tokens are tokenized", "[tokenizer]") {
   diagnostic_reporter rep;
   tokenizer t("<test>", ":one:!two", rep);
-  auto& tok1 = t.next_token(token_len_5);
+  auto const& tok1 = t.next_token(token_len_5);
   REQUIRE(tok1.text == ":one:");
   REQUIRE(tok1.type == token_type::oper);
   REQUIRE(!tok1.error);
 
-  auto& tok2 = t.next_token(token_len_5);
+  auto const& tok2 = t.next_token(token_len_5);
   REQUIRE(tok2.text == "!two");
   REQUIRE(tok2.type == token_type::oper);
   REQUIRE(!tok2.error);
@@ -135,3 +240,432 @@ TEST_CASE("Whitespace can be skipped", "[tokenizer]") {
   t.skip_whitespace();
   REQUIRE(t.next_token(token_always_exist).type == token_type::function_identifier);
 }
+
+TEST_CASE("A bound operator lookup is used by next_token", "[tokenizer]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", ":one:!two", rep);
+  t.bind_operator_lookup(token_len_5);
+  REQUIRE(t.next_token().text == ":one:");
+  REQUIRE(t.next_token().text == "!two");
+  REQUIRE(t.next_token().type == token_type::eof);
+}
+
+TEST_CASE("A std::function lookup still works", "[tokenizer]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", ":one:!two", rep);
+  const tokenizer::lookup_fn_t lookup = token_len_5;
+  REQUIRE(t.next_token(lookup).text == ":one:");
+  REQUIRE(t.next_token(lookup).text == "!two");
+}
+
+TEST_CASE("Token positions are resolved from byte offsets", "[tokenizer]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "a \n\n  bc?", rep);
+  t.next_token(token_always_exist);
+  const auto ws = t.next_token(token_always_exist);
+  const auto id = t.next_token(token_always_exist);
+  REQUIRE(t.range(ws).start.line == 1);
+  REQUIRE(t.range(ws).start.offset == 1);
+  REQUIRE(t.range(ws).end.line == 3);
+  REQUIRE(t.range(ws).end.offset == 2);
+  REQUIRE(t.range(id).start.line == 3);
+  REQUIRE(t.range(id).start.offset == 2);
+  REQUIRE(t.range(id).end.offset == 5);
+}
+
+TEST_CASE("The checkpointer truncates the stored tokens", "[tokenizer]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "a 42a b", rep);
+  t.next_token(token_always_exist);
+  t.next_token(token_always_exist);
+  {
+    tokenizer::checkpointer c{t};
+    REQUIRE(t.next_token(token_always_exist).error);
+    REQUIRE(t.tokens().size() == 3);
+  }
+  REQUIRE(t.tokens().size() == 2);
+  REQUIRE(!t.tokens().error(1));
+  REQUIRE(t.next_token(token_always_exist).text == "42");
+  REQUIRE(t.tokens().error(2));
+}
+
+TEST_CASE("An unexpected character is skipped with an error", "[tokenizer]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "a.b", rep);
+  REQUIRE(t.next_token(token_always_exist).text == "a");
+  const auto bad = t.next_token(token_always_exist);
+  REQUIRE(bad.type == token_type::unknown);
+  REQUIRE(bad.text == ".");
+  REQUIRE(bad.error);
+  REQUIRE(t.next_token(token_always_exist).text == "b");
+  REQUIRE(rep.messages().size() == 2);  // the continuation of 'a', and the character
+}
+
+TEST_CASE("Lexical errors stop being stored at the error cap", "[tokenizer]") {
+  diagnostic_reporter rep({10, 5});
+  std::string text;
+  for (int i = 0; i < 100000; ++i) {
+    text += "a. ";
+  }
+  tokenizer t("<test>", text, rep);
+  while (t.next_token(token_always_exist).type != token_type::eof) {
+  }
+  REQUIRE(rep.messages().size() == 10);  // 5 of both codes
+  REQUIRE(rep.error_count() == 200000);
+  REQUIRE(rep.suppressed() == 199990);
+}
+
+TEST_CASE("Lexical errors lexed again after a rollback are counted once", "[tokenizer]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "a. 18446744073709551616 b", rep);
+  for (int round = 0; round < 3; ++round) {
+    tokenizer::checkpointer c{t};
+    while (t.next_token(token_always_exist).type != token_type::eof) {
+    }
+  }
+  REQUIRE(t.tokens().size() == 0);
+  REQUIRE(rep.error_count() == 3);  // the continuation of 'a', the character, the overflow
+  REQUIRE(rep.messages().size() == 3);
+}
+
+TEST_CASE("An edit reports the errors of the text lexed again", "[tokenizer]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "a b. c", rep);
+  while (t.next_token(token_always_exist).type != token_type::eof) {
+  }
+  REQUIRE(rep.error_count() == 2);
+  t.apply_edit({0, 1, "#"});
+  while (t.next_token(token_always_exist).type != token_type::eof) {
+  }
+  REQUIRE(rep.error_count() == 3);  // the new character, not the continuation of 'b' again
+}
+
+namespace {
+// bytes allocated and not freed, 0 where malloc can't tell
+long allocated_now() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  const auto info = mallinfo2();
+  return static_cast<long>(info.uordblks + info.hblkhd);
+#else
+  return 0;
+#endif
+}
+}  // namespace
+
+TEST_CASE("An input of only errors is lexed in the time and memory of a valid one", "[tokenizer]") {
+  constexpr std::size_t tokens = 1 << 20;
+  // seconds, and the bytes held besides the text and tokens
+  const auto lex = [](std::string const& text) {
+    diagnostic_reporter rep;
+    const auto before = allocated_now();
+    tokenizer t("<test>", text, rep);
+    const auto start = std::chrono::steady_clock::now();
+    while (t.next_token(token_always_exist).type != token_type::eof) {
+    }
+    const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    REQUIRE(t.tokens().size() == tokens + 1);
+    const auto held = allocated_now() - before - static_cast<long>(t.tokens().memory_usage() + text.size());
+    return std::make_pair(seconds, held);
+  };
+
+  std::string valid;
+  for (std::size_t i = 0; i < tokens / 2; ++i) {
+    valid += "a ";
+  }
+  const auto [valid_seconds, valid_held] = lex(valid);
+  const auto [error_seconds, error_held] = lex(std::string(tokens, '#'));
+  REQUIRE(error_seconds < 3 * valid_seconds + 0.05);
+  REQUIRE(error_held < valid_held + (1 << 20));
+}
+
+TEST_CASE("Numbers are decoded while lexing", "[tokenizer]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "0 42 -7 0000123 18446744073709551615 -9223372036854775808", rep);
+  std::vector<std::uint64_t> values;
+  std::vector<bool> signs;
+  for (;;) {
+    const auto tok = t.next_token(token_always_exist);
+    if (tok.type == token_type::eof) {
+      break;
+    }
+    if (tok.type == token_type::numeric) {
+      REQUIRE(!tok.error);
+      values.push_back(tok.value);
+      signs.push_back(tok.negative);
+      REQUIRE(t.tokens().negative(t.cursor() - 1) == tok.negative);
+    }
+  }
+  REQUIRE(values == std::vector<std::uint64_t>{0, 42, 7, 123, 18446744073709551615ull, 9223372036854775808ull});
+  REQUIRE(signs == std::vector<bool>{false, false, true, false, false, true});
+  REQUIRE(rep.error_count() == 0);
+}
+
+TEST_CASE("Numbers out of the 64 bit range are lexical errors", "[tokenizer]") {
+  for (std::string text : {"18446744073709551616", "-9223372036854775809", "123456789012345678901234567890"}) {
+    diagnostic_reporter rep;
+    tokenizer t("<test>", text, rep);
+    const auto tok = t.next_token(token_always_exist);
+    REQUIRE(tok.type == token_type::numeric);
+    REQUIRE(tok.text == text);
+    REQUIRE(tok.error);
+    REQUIRE(tok.value == 0);
+    REQUIRE(rep.messages().size() == 1);
+    REQUIRE(rep.messages()[0].diag.diagnostic_code() == 4);
+  }
+
+  // a continuation error is not an overflow
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "42a", rep);
+  const auto tok = t.next_token(token_always_exist);
+  REQUIRE(tok.error);
+  REQUIRE(tok.value == 0);
+  REQUIRE(rep.messages().empty());
+}
+
+TEST_CASE("A stream read in small chunks gives the same tokens", "[tokenizer]") {
+  const auto text = mixed_text(200);
+  diagnostic_reporter full_rep;
+  tokenizer full("<test>", text, full_rep);
+
+  pipe_source source(text);
+  diagnostic_reporter rep;
+  tokenizer t("<stdin>", source.fd(), rep, 7);
+  for (;;) {
+    const auto expected = full.next_token(token_len_5);
+    const auto tok = t.next_token(token_len_5);
+    REQUIRE(tok.type == expected.type);
+    REQUIRE(tok.text == expected.text);
+    REQUIRE(tok.error == expected.error);
+    REQUIRE(t.range(tok).start.line == full.range(expected).start.line);
+    REQUIRE(t.range(tok).start.offset == full.range(expected).start.offset);
+    REQUIRE(t.range(tok).end.offset == full.range(expected).end.offset);
+    if (tok.type == token_type::eof) {
+      break;
+    }
+  }
+  REQUIRE(t.tokens().size() == full.tokens().size());
+  REQUIRE(t.content_offset() + t.content().size() == text.size());
+  REQUIRE(rep.error_count() == full_rep.error_count());
+}
+
+TEST_CASE("A stream is lexed in bounded memory", "[tokenizer]") {
+  std::string text;
+  for (int i = 0; i < 100000; ++i) {
+    text += "a = 1;\n";
+  }
+  pipe_source source(text);
+  diagnostic_reporter rep;
+  tokenizer t("<stdin>", source.fd(), rep, 64);
+  std::size_t window = 0;
+  std::size_t tokens = 0;
+  while (t.next_token(token_always_exist).type != token_type::eof) {
+    window = std::max(window, t.content().size());
+    tokens = std::max(tokens, t.tokens().size() - t.tokens().first());
+  }
+  REQUIRE(t.tokens().size() == 100000 * 7 + 1);
+  REQUIRE(t.range(t.token_at(t.tokens().size() - 1)).start.line == 100001);
+  REQUIRE(window <= 128);
+  REQUIRE(tokens <= 128);
+}
+
+TEST_CASE("A live checkpointer keeps the stream it can roll back to", "[tokenizer]") {
+  std::string text = "first second";
+  for (int i = 0; i < 1000; ++i) {
+    text += " x";
+  }
+  pipe_source source(text);
+  diagnostic_reporter rep;
+  tokenizer t("<stdin>", source.fd(), rep, 16);
+  REQUIRE(t.next_token(token_always_exist).text == "first");
+  {
+    tokenizer::checkpointer c{t};
+    while (t.next_token(token_always_exist).type != token_type::eof) {
+    }
+    REQUIRE(t.tokens().first() == 0);
+  }
+  REQUIRE(t.skip_whitespace());
+  REQUIRE(t.next_token(token_always_exist).text == "second");
+  while (t.next_token(token_always_exist).type != token_type::eof) {
+  }
+}
+
+TEST_CASE("Lexing in parts gives the tokens of one pass", "[tokenizer]") {
+  thread_pool pool(4);
+  const std::vector<std::string> texts{
+      "42",          ":not:",       "42 ",        "42a",  "42;", "[{}(]", "-42",    "commit", "commit?",
+      "a.b",         "a\n.b\n c", "\n\n\n",  "",     " x ", "a \n", "\n a",  "a\n",   "::::::\n::",
+      "a b\nc d\n", mixed_text(1), mixed_text(50)};
+  for (auto const& text : texts) {
+    for (const std::size_t parts : {1, 2, 3, 7, 64}) {
+      expect_parallel_lex(pool, text, token_always_exist, parts);
+      expect_parallel_lex(pool, text, token_len_5, parts);
+      expect_parallel_lex(pool, text, token_never_exist, parts);
+    }
+  }
+}
+
+TEST_CASE("Lexing random texts in parts gives the tokens of one pass", "[tokenizer]") {
+  thread_pool pool(4);
+  std::mt19937 rng(4321);
+  for (int round = 0; round < 200; ++round) {
+    const auto text = random_text(rng, 1 + rng() % 2000);
+    const std::size_t parts = 1 + rng() % 16;
+    expect_parallel_lex(pool, text, token_len_5, parts);
+    expect_parallel_lex(pool, text, token_always_exist, parts, {10, 3});
+  }
+}
+
+TEST_CASE("A large text is lexed in parts with the error caps of one pass", "[tokenizer]") {
+  thread_pool pool(4);
+  std::string text;
+  for (int i = 0; i < 20000; ++i) {
+    text += "blk" + std::to_string(i) + " = { a :op: b? -" + std::to_string(i) + ";\n  x. 9z\t[y] };\n";
+  }
+  expect_parallel_lex(pool, text, token_len_5, 8);
+  expect_parallel_lex(pool, text, token_len_5, 8, {10, 5});
+}
+
+TEST_CASE("A stalled operator in a later part ends the tokens", "[tokenizer]") {
+  thread_pool pool(2);
+  std::string text;
+  for (int i = 0; i < 500; ++i) {
+    text += "a b\n";
+  }
+  text += "c :: d\n";
+  for (int i = 0; i < 500; ++i) {
+    text += "e f\n";
+  }
+  expect_parallel_lex(pool, text, token_never_exist, 4);
+
+  diagnostic_reporter rep;
+  tokenizer t("<test>", text, rep);
+  t.lex_parallel(pool, 4);
+  const auto last = t.token_at(t.tokens().size() - 1);
+  REQUIRE(last.type == token_type::oper);
+  REQUIRE(last.text.empty());
+  REQUIRE(t.range(last).start.line == 501);
+}
+
+TEST_CASE("Lexing in parts continues after the tokens read so far", "[tokenizer]") {
+  thread_pool pool(3);
+  const auto text = mixed_text(100);
+  diagnostic_reporter rep;
+  tokenizer t("<test>", text, rep);
+  t.bind_operator_lookup(token_len_5);
+  for (int i = 0; i < 10; ++i) {
+    t.next_token();
+  }
+  t.seek(4);  // replayed first
+  t.lex_parallel(pool, 3);
+  REQUIRE(t.tokens().kind(t.tokens().size() - 1) == token_type::eof);
+
+  diagnostic_reporter full_rep;
+  tokenizer full("<test>", text, full_rep);
+  full.bind_operator_lookup(token_len_5);
+  while (full.next_token().type != token_type::eof) {
+  }
+  REQUIRE(t.tokens().size() == full.tokens().size());
+  REQUIRE(rep.error_count() == full_rep.error_count());
+
+  t.lex_parallel(pool, 3);  // at the end: nothing to do
+  REQUIRE(t.tokens().size() == full.tokens().size());
+}
+
+TEST_CASE("A pipelined tokenizer hands out the tokens of one pass", "[tokenizer]") {
+  std::mt19937 rng(2024);
+  std::vector<std::string> texts{"", "a", mixed_text(300), "a b\nc :: d\ne f"};
+  for (int i = 0; i < 50; ++i) {
+    texts.push_back(random_text(rng, 1 + rng() % 3000));
+  }
+  for (auto const& text : texts) {
+    for (const std::size_t lookahead : {1, 4, 4096}) {
+      diagnostic_reporter seq_rep;
+      tokenizer seq("<test>", text, seq_rep);
+      seq.bind_operator_lookup(token_len_5);
+
+      diagnostic_reporter rep;
+      tokenizer t("<test>", text, rep);
+      t.bind_operator_lookup(token_len_5);
+      t.start_pipeline(lookahead);
+      REQUIRE(t.pipelined());
+      for (;;) {
+        const auto expected = seq.next_token();
+        const auto tok = t.next_token(token_never_exist);  // ignored while pipelined
+        REQUIRE(tok.type == expected.type);
+        REQUIRE(tok.text == expected.text);
+        REQUIRE(tok.error == expected.error);
+        REQUIRE(tok.symbol == expected.symbol);
+        REQUIRE(tok.value == expected.value);
+        if (tok.type == token_type::eof || tok.text.empty()) {
+          break;
+        }
+      }
+      REQUIRE(!t.pipelined());
+      REQUIRE(rep.error_count() == seq_rep.error_count());
+      REQUIRE(rep.messages().size() == seq_rep.messages().size());
+    }
+  }
+}
+
+TEST_CASE("A rolled back checkpointer rewinds a pipelined tokenizer to its tokens", "[tokenizer]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", mixed_text(100), rep);
+  t.bind_operator_lookup(token_len_5);
+  t.start_pipeline(8);
+  REQUIRE(t.next_token().text == "int");
+  {
+    tokenizer::checkpointer c{t};
+    for (int i = 0; i < 40; ++i) {
+      t.next_token();
+    }
+  }
+  REQUIRE(t.cursor() == 1);
+  REQUIRE(t.tokens().size() == 41);  // kept, they don't depend on the parse
+  REQUIRE(t.skip_whitespace());
+  REQUIRE(t.next_token().text == "a0");
+  REQUIRE(t.pipelined());
+}
+
+TEST_CASE("A checkpointer rolled back after the pipeline ended keeps its tokens", "[tokenizer]") {
+  diagnostic_reporter rep;
+  tokenizer t("<test>", "{ u8 a = 1", rep);
+  t.bind_operator_lookup(token_always_exist);
+  t.start_pipeline(8);
+  REQUIRE(t.next_token().text == "{");
+  {
+    tokenizer::checkpointer c{t};
+    while (t.next_token().type != token_type::eof) {
+    }
+    REQUIRE(!t.pipelined());  // ended at the eof
+  }
+  REQUIRE(t.cursor() == 1);
+  REQUIRE(t.tokens().size() == 10);
+  REQUIRE(t.token_at(9).type == token_type::eof);
+}
+
+TEST_CASE("A stopped pipeline continues on the calling thread", "[tokenizer]") {
+  const auto text = mixed_text(100);
+  diagnostic_reporter full_rep;
+  tokenizer full("<test>", text, full_rep);
+  full.bind_operator_lookup(token_len_5);
+  while (full.next_token().type != token_type::eof) {
+  }
+
+  diagnostic_reporter rep;
+  tokenizer t("<test>", text, rep);
+  t.bind_operator_lookup(token_len_5);
+  t.start_pipeline(16);
+  for (int i = 0; i < 100; ++i) {
+    t.next_token();
+  }
+  t.stop_pipeline();  // what the producer lexed beyond is dropped
+  REQUIRE(!t.pipelined());
+  REQUIRE(t.tokens().size() == 100);
+  while (t.next_token().type != token_type::eof) {
+  }
+  REQUIRE(t.tokens().size() == full.tokens().size());
+  for (std::size_t i = 0; i < t.tokens().size(); ++i) {
+    REQUIRE(t.tokens().start(i) == full.tokens().start(i));
+    REQUIRE(t.tokens().kind(i) == full.tokens().kind(i));
+  }
+}